@@ -0,0 +1,3 @@
+#!/bin/bash
+./build/convert_mnist_cache mnist-datasets/train-images.idx3-ubyte mnist-datasets/train-labels.idx1-ubyte mnist-datasets/train.cache f32
+./build/convert_mnist_cache mnist-datasets/t10k-images.idx3-ubyte mnist-datasets/t10k-labels.idx1-ubyte mnist-datasets/t10k.cache f32
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <vector>
+#include <omp.h>
+
+struct AugmentationOptions {
+    bool enabled = false;
+    float maxShift = 2.0f;            // Largest translation, in pixels
+    float maxRotationDegrees = 10.0f; // Largest rotation either way
+    float elasticAlpha = 0.0f;        // Scale of the elastic displacement field, in pixels (0 disables it)
+    float elasticSigma = 4.0f;        // Gaussian smoothing of the displacement field
+    int threads = 0;                  // Worker threads for a batch (0 uses the OpenMP default)
+};
+
+// splitmix64 finalizer, used to derive independent per-sample seeds
+inline uint64_t mixSeed(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+// Random translation, rotation and elastic distortion of square-ish images. The samples of
+// a batch are warped in parallel on the OpenMP worker pool, each from its own generator
+// derived from (seed, batch, row), so results do not depend on the thread count.
+class Augmenter {
+public:
+    Augmenter(size_t rows, size_t cols, size_t maxBatch, const AugmentationOptions& options, uint64_t seed)
+        : rows_(rows), cols_(cols), options_(options), seed_(seed),
+          fields_(options.elasticAlpha > 0.0f ? maxBatch * rows * cols * 3 : 0) {
+        // One-dimensional Gaussian taps for the separable blur of the displacement field
+        if (options_.elasticAlpha > 0.0f) {
+            int radius = std::max(1, static_cast<int>(std::ceil(3.0f * options_.elasticSigma)));
+            kernel_.resize(2 * radius + 1);
+            float sum = 0.0f;
+            for (int k = -radius; k <= radius; ++k) {
+                float tap = std::exp(-0.5f * k * k / (options_.elasticSigma * options_.elasticSigma));
+                kernel_[k + radius] = tap;
+                sum += tap;
+            }
+            for (float& tap : kernel_) {
+                tap /= sum;
+            }
+        }
+    }
+
+    // Warp count images into dst, rows * cols floats per image in the units of the source
+    template<typename Source>
+    void apply(const Source* const* samples, float* dst, size_t count) {
+        uint64_t batchSeed = mixSeed(seed_ ^ mixSeed(batches_++));
+        int threads = options_.threads > 0 ? options_.threads : omp_get_max_threads();
+
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (long i = 0; i < static_cast<long>(count); ++i) {
+            warp(samples[i], dst + i * rows_ * cols_, static_cast<size_t>(i), batchSeed);
+        }
+    }
+
+private:
+    size_t rows_;
+    size_t cols_;
+    AugmentationOptions options_;
+    uint64_t seed_;
+    uint64_t batches_ = 0;
+    std::vector<float> kernel_;
+    std::vector<float> fields_; // Per-row displacement fields (dx, dy, blur scratch)
+
+    template<typename Source>
+    void warp(const Source* src, float* dst, size_t row, uint64_t batchSeed) {
+        const size_t imageSize = rows_ * cols_;
+        std::mt19937 gen(static_cast<uint32_t>(mixSeed(batchSeed + row)));
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        float angle = unit(gen) * options_.maxRotationDegrees * std::numbers::pi_v<float> / 180.0f;
+        float shiftY = unit(gen) * options_.maxShift;
+        float shiftX = unit(gen) * options_.maxShift;
+        float cosA = std::cos(angle);
+        float sinA = std::sin(angle);
+        float centerY = 0.5f * (rows_ - 1);
+        float centerX = 0.5f * (cols_ - 1);
+
+        const float* dispX = nullptr;
+        const float* dispY = nullptr;
+        if (options_.elasticAlpha > 0.0f) {
+            float* field = fields_.data() + row * imageSize * 3;
+            for (size_t k = 0; k < 2 * imageSize; ++k) {
+                field[k] = unit(gen);
+            }
+            smooth(field, field + 2 * imageSize);
+            smooth(field + imageSize, field + 2 * imageSize);
+            dispX = field;
+            dispY = field + imageSize;
+        }
+
+        // Inverse mapping: every output pixel samples the source bilinearly, zero outside
+        const long height = static_cast<long>(rows_);
+        const long width = static_cast<long>(cols_);
+        for (long r = 0; r < height; ++r) {
+            #pragma omp simd
+            for (long c = 0; c < width; ++c) {
+                size_t k = r * width + c;
+                float y = r - centerY;
+                float x = c - centerX;
+                float sy = cosA * y - sinA * x + centerY - shiftY;
+                float sx = sinA * y + cosA * x + centerX - shiftX;
+                if (dispX) {
+                    sy += options_.elasticAlpha * dispY[k];
+                    sx += options_.elasticAlpha * dispX[k];
+                }
+
+                float fy = std::floor(sy);
+                float fx = std::floor(sx);
+                long y0 = static_cast<long>(fy);
+                long x0 = static_cast<long>(fx);
+                float wy = sy - fy;
+                float wx = sx - fx;
+
+                float p00 = pixel(src, y0, x0, height, width);
+                float p01 = pixel(src, y0, x0 + 1, height, width);
+                float p10 = pixel(src, y0 + 1, x0, height, width);
+                float p11 = pixel(src, y0 + 1, x0 + 1, height, width);
+                dst[k] = (1.0f - wy) * ((1.0f - wx) * p00 + wx * p01) + wy * ((1.0f - wx) * p10 + wx * p11);
+            }
+        }
+    }
+
+    template<typename Source>
+    static float pixel(const Source* src, long y, long x, long height, long width) {
+        bool inside = y >= 0 && y < height && x >= 0 && x < width;
+        return inside ? static_cast<float>(src[y * width + x]) : 0.0f;
+    }
+
+    // Separable Gaussian blur of one field in place, clamping at the borders. Both passes
+    // accumulate one tap at a time across a whole row so the inner loops vectorize.
+    void smooth(float* field, float* scratch) const {
+        const long height = static_cast<long>(rows_);
+        const long width = static_cast<long>(cols_);
+        const long radius = static_cast<long>(kernel_.size() / 2);
+
+        for (long r = 0; r < height; ++r) {
+            const float* in = field + r * width;
+            float* out = scratch + r * width;
+            std::fill(out, out + width, 0.0f);
+            for (long k = -radius; k <= radius; ++k) {
+                float tap = kernel_[k + radius];
+                long first = std::clamp(-k, 0L, width);
+                long last = std::clamp(width - k, first, width);
+                for (long c = 0; c < first; ++c) {
+                    out[c] += tap * in[0];
+                }
+                #pragma omp simd
+                for (long c = first; c < last; ++c) {
+                    out[c] += tap * in[c + k];
+                }
+                for (long c = last; c < width; ++c) {
+                    out[c] += tap * in[width - 1];
+                }
+            }
+        }
+        for (long r = 0; r < height; ++r) {
+            float* out = field + r * width;
+            std::fill(out, out + width, 0.0f);
+            for (long k = -radius; k <= radius; ++k) {
+                float tap = kernel_[k + radius];
+                const float* in = scratch + std::clamp(r + k, 0L, height - 1) * width;
+                #pragma omp simd
+                for (long c = 0; c < width; ++c) {
+                    out[c] += tap * in[c];
+                }
+            }
+        }
+    }
+};
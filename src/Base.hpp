@@ -2,27 +2,46 @@
 
 #include "Optimizers.hpp"
 #include "Initializers.hpp"
+#include "Types.hpp"
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include <Eigen/Dense>
 
-// Define MatrixType as an alias for Eigen::Matrix with dynamic rows and columns
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
+// Storage order by the names bench_layout reports them under
+inline int parseStorageOrder(const std::string& name) {
+    if (name == "col-major") return Eigen::ColMajor;
+    if (name == "row-major") return Eigen::RowMajor;
+    throw std::invalid_argument("Unknown storage order: " + name);
+}
 
-template<typename ComponentType>
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
 class BaseLayer {
 public:
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+
     BaseLayer() = default;
     virtual ~BaseLayer() = default;
 
     // Indicates if the layer is trainable (pure virtual)
     virtual bool is_trainable() const = 0;
 
-    // Forward pass (pure virtual)
-    virtual MatrixType<ComponentType> forward(const MatrixType<ComponentType>& input_tensor) = 0;
+    // Forward pass (pure virtual). A layer may cache its input by reference for backward(),
+    // so the input has to outlive the matching backward() or a call to forget_input().
+    virtual Matrix forward(const Matrix& input_tensor) = 0;
+
+    // Backward pass: returns the error with respect to the input and adds the parameter
+    // gradients of the batch to the accumulated ones, without touching the parameters (pure virtual)
+    virtual Matrix backward(const Matrix& error_tensor) = 0;
+
+    // Step the optimizer with the gradients accumulated since the last update, then start
+    // accumulating afresh (optional override)
+    virtual void apply_update() {}
 
-    // Backward pass (pure virtual)
-    virtual MatrixType<ComponentType> backward(const MatrixType<ComponentType>& error_tensor) = 0;
+    // Whether backward() has to return the error with respect to the input. When it does
+    // not, backward() may return an empty matrix (optional override)
+    virtual void set_input_gradient_needed(bool needed) {}
 
     // Set optimizer (optional override)
     virtual void set_optimizer(std::shared_ptr<Optimizer<ComponentType>> optimizer) {}
@@ -31,6 +50,14 @@ public:
     virtual void initialize(const std::shared_ptr<Initializer<ComponentType>>& weights_initializer,
                             const std::shared_ptr<Initializer<ComponentType>>& bias_initializer) {}
 
+    // Drop any reference to the input of the last forward(), for when that input goes away
+    // without a backward() (optional override)
+    virtual void forget_input() {}
+
+    // Keep only the given batch rows of the state cached by forward(), so that the next
+    // backward() runs on that subset of the batch (optional override)
+    virtual void select_rows(const std::vector<Eigen::Index>& rows) {}
+
 protected:
     bool trainable = false;
 };
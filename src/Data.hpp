@@ -6,60 +6,466 @@
 #include <string>
 #include <algorithm>
 #include <random>
+#include <numeric>
+#include <bit>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <glob.h>
 #include <Eigen/Dense>
+#include "DataSource.hpp"
+#include "Endian.hpp"
+#include "DataReaders.hpp"
+#include "DatasetCache.hpp"
+#include "TabularReaders.hpp"
+#include "Normalize.hpp"
+#include "Augmentation.hpp"
+#include "Pipeline.hpp"
 
-// Define MatrixType as an alias for Eigen::Matrix with dynamic dimensions
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
+// Storage backend used by DataLayer to fetch samples
+enum class DataBackend {
+    Stream,       // Opens the files and seeks for every sample
+    MemoryMapped, // Maps both files once and addresses samples in place
+    Preload,      // Loads both files into memory once at construction
+    Cache,        // Maps a file written by convert_mnist_cache (the image path names the cache,
+                  // the label path is unused)
+    Streaming,    // Out-of-core: reads large sequential chunks through a bounded shuffle buffer
+    Csv,          // Parses a CSV of class index and float features into memory (label path unused)
+    RawFloat      // Maps a raw little-endian float32 feature file (label path unused)
+};
 
-// Helper function to convert big-endian to little-endian
-uint32_t bigEndianToLittleEndian(uint32_t value) {
-    return ((value >> 24) & 0xff) |
-           ((value << 8) & 0xff0000) |
-           ((value >> 8) & 0xff00) |
-           ((value << 24) & 0xff000000);
+// Whether a backend reads its labels from the label path; the others carry them in the
+// image path's file
+inline bool backendUsesLabelFile(DataBackend backend) {
+    return backend != DataBackend::Cache && backend != DataBackend::Csv && backend != DataBackend::RawFloat;
 }
 
-template<typename ComponentType>
-class DataLayer {
+inline DataBackend parseDataBackend(const std::string& name) {
+    if (name == "stream") return DataBackend::Stream;
+    if (name == "mmap") return DataBackend::MemoryMapped;
+    if (name == "preload") return DataBackend::Preload;
+    if (name == "cache") return DataBackend::Cache;
+    if (name == "streaming") return DataBackend::Streaming;
+    if (name == "csv") return DataBackend::Csv;
+    if (name == "rawf32") return DataBackend::RawFloat;
+    throw std::invalid_argument("Unknown data backend: " + name);
+}
+
+// Expand a dataset path into its files: a comma-separated list whose entries may be glob
+// patterns, each pattern contributing its matches in sorted order
+inline std::vector<std::string> expandDatasetPaths(const std::string& spec) {
+    std::vector<std::string> paths;
+    size_t begin = 0;
+    while (begin <= spec.size()) {
+        size_t end = std::min(spec.find(',', begin), spec.size());
+        std::string entry = spec.substr(begin, end - begin);
+        begin = end + 1;
+        if (entry.empty()) {
+            continue;
+        }
+        if (entry.find_first_of("*?[") == std::string::npos) {
+            paths.push_back(entry);
+            continue;
+        }
+
+        glob_t matches;
+        if (::glob(entry.c_str(), 0, nullptr, &matches) != 0) {
+            ::globfree(&matches);
+            throw std::runtime_error("No files match: " + entry);
+        }
+        for (size_t k = 0; k < matches.gl_pathc; ++k) {
+            paths.push_back(matches.gl_pathv[k]);
+        }
+        ::globfree(&matches);
+    }
+    if (paths.empty()) {
+        throw std::invalid_argument("Empty dataset path.");
+    }
+    return paths;
+}
+
+// Order in which a shuffling DataLayer visits the samples of an epoch
+enum class ShuffleMode {
+    Full,      // Uniform permutation of every sample index
+    Block,     // Permute contiguous blocks, then shuffle within windows of a few blocks
+    Feistel,   // Seeded bijection computed per position, without any index array
+    Importance // Draw with replacement, proportionally to each sample's last reported loss
+};
+
+inline ShuffleMode parseShuffleMode(const std::string& name) {
+    if (name == "full") return ShuffleMode::Full;
+    if (name == "block") return ShuffleMode::Block;
+    if (name == "feistel") return ShuffleMode::Feistel;
+    if (name == "importance") return ShuffleMode::Importance;
+    throw std::invalid_argument("Unknown shuffle mode: " + name);
+}
+
+// Seeded bijection on [0, size): a balanced Feistel network over the smallest even number
+// of bits covering size, cycle-walking until the result falls back inside the range. The
+// network's domain is under 4 * size, so a lookup walks fewer than four times on average.
+class FeistelPermutation {
+public:
+    FeistelPermutation() = default;
+
+    FeistelPermutation(uint64_t size, uint64_t seed) : size_(size) {
+        unsigned bits = 2;
+        while (bits < 64 && (uint64_t{1} << bits) < size) {
+            bits += 2;
+        }
+        halfBits_ = bits / 2;
+        halfMask_ = (uint64_t{1} << halfBits_) - 1;
+        for (int r = 0; r < rounds; ++r) {
+            roundKeys_[r] = mixSeed(seed + r);
+        }
+    }
+
+    uint64_t operator()(uint64_t index) const {
+        do {
+            index = encrypt(index);
+        } while (index >= size_);
+        return index;
+    }
+
+private:
+    static constexpr int rounds = 4;
+    uint64_t size_ = 0;
+    unsigned halfBits_ = 1;
+    uint64_t halfMask_ = 1;
+    uint64_t roundKeys_[rounds] = {};
+
+    uint64_t encrypt(uint64_t value) const {
+        uint64_t left = value >> halfBits_;
+        uint64_t right = value & halfMask_;
+        for (int r = 0; r < rounds; ++r) {
+            uint64_t mixed = left ^ (mixSeed(right ^ roundKeys_[r]) & halfMask_);
+            left = right;
+            right = mixed;
+        }
+        return (left << halfBits_) | right;
+    }
+};
+
+// Fenwick tree over non-negative sample scores: O(log N) score updates and O(log N) draws
+// of an index with probability proportional to its score
+class ScoreSampler {
 public:
-    DataLayer(const std::string& imageFile, const std::string& labelFile, size_t batchSize, bool shuffle = false)
-        : imageFile_(imageFile), labelFile_(labelFile), batchSize_(batchSize), shuffle_(shuffle), currentIndex_(0) {
+    ScoreSampler() = default;
+
+    ScoreSampler(size_t size, double initialScore) : scores_(size, initialScore), tree_(size + 1, 0.0) {
+        // Linear-time construction: every node passes its partial sum up to its parent
+        for (size_t i = 1; i <= size; ++i) {
+            tree_[i] += initialScore;
+            size_t parent = i + (i & (~i + 1));
+            if (parent <= size) {
+                tree_[parent] += tree_[i];
+            }
+        }
+    }
+
+    void update(size_t index, double score) {
+        double delta = score - scores_[index];
+        scores_[index] = score;
+        for (size_t i = index + 1; i < tree_.size(); i += i & (~i + 1)) {
+            tree_[i] += delta;
+        }
+    }
+
+    double total() const {
+        double sum = 0.0;
+        for (size_t i = scores_.size(); i > 0; i -= i & (~i + 1)) {
+            sum += tree_[i];
+        }
+        return sum;
+    }
+
+    // Index whose cumulative score range contains target, for target in [0, total())
+    size_t find(double target) const {
+        size_t position = 0;
+        size_t step = std::bit_floor(scores_.size());
+        for (; step > 0; step >>= 1) {
+            if (position + step < tree_.size() && tree_[position + step] <= target) {
+                target -= tree_[position + step];
+                position += step;
+            }
+        }
+        // Rounding can walk past the last sample when target is close to the total
+        return std::min(position, scores_.size() - 1);
+    }
+
+    template<typename Generator>
+    size_t sample(Generator& gen) const {
+        return find(std::uniform_real_distribution<double>(0.0, total())(gen));
+    }
+
+private:
+    std::vector<double> scores_;
+    std::vector<double> tree_; // 1-based partial sums
+};
+
+struct DataLayerOptions {
+    DataBackend backend = DataBackend::Stream;
+    size_t prefetchDepth = 0; // Batches loaded ahead by a background thread (0 loads in next())
+
+    // Data-parallel sharding: every shard walks the same per-epoch permutation and serves
+    // only its own contiguous slice of it. Shuffled shards must share a non-zero seed.
+    size_t shardId = 0;
+    size_t shardCount = 1;
+    unsigned seed = 0; // 0 seeds the shuffle from std::random_device
+
+    // Block shuffling keeps reads within a window of a few contiguous file regions
+    ShuffleMode shuffleMode = ShuffleMode::Full;
+    size_t shuffleBlockSize = 256;   // Samples per contiguous block
+    size_t shuffleWindowBlocks = 16; // Blocks mixed together in one window
+
+    // End every epoch with a smaller batch holding exactly the samples that are left,
+    // instead of filling the batch up from the next epoch
+    bool partialFinalBatch = false;
+
+    // Width of one-hot label batches; a cache file's header must agree with it
+    size_t numClasses = 10;
+
+    // Streaming backend: memory is bounded by (streamChunkSize + shuffleBufferSize) samples.
+    // Each shard streams its own contiguous slice of the file, and shuffling only mixes
+    // samples within the buffer.
+    size_t streamChunkSize = 4096;    // Samples per sequential read
+    size_t shuffleBufferSize = 16384; // Samples a shuffled draw is taken from
+
+    // Importance sampling: a sample's score is its last reported loss plus the floor, which
+    // keeps every sample reachable. Samples not yet seen keep the initial score.
+    double importanceFloor = 0.05;
+    double importanceInitialScore = 1.0;
+
+    // Threads fetching the samples of a batch. With a dataset split over several files,
+    // samples from different files are then read concurrently.
+    size_t readerThreads = 1;
+
+    // Random warps applied to every image before it is written into the batch
+    AugmentationOptions augmentation;
+};
+
+// One sample on its way through DataLayer::epochPipeline(). It stays in the units of the
+// source until the batch stage normalizes it, exactly as next() does. Samples that cannot
+// be addressed in place live in buffers lent from a pool.
+struct PipelineSample {
+    size_t index = 0;
+    int32_t label = 0;
+    const uint8_t* pixels = nullptr; // Pixels as stored, for pixel sources
+    const float* values = nullptr;   // Stored floats of normalized sources, or augmented values
+    PooledBuffer<uint8_t> pixelBuffer;
+    PooledBuffer<float> valueBuffer;
+};
+
+// Serves batches in the given storage order; samples are widened straight into it
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
+class DataLayer : public DataSource<ComponentType, StorageOrder> {
+public:
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+
+    DataLayer(const std::string& imageFile, const std::string& labelFile, size_t batchSize, bool shuffle = false,
+              DataLayerOptions options = {})
+        : imageFile_(imageFile), labelFile_(labelFile), batchSize_(batchSize), shuffle_(shuffle),
+          options_(options), currentIndex_(0) {
+        if (options_.shardCount == 0 || options_.shardId >= options_.shardCount) {
+            throw std::invalid_argument("Shard id must be smaller than the shard count.");
+        }
+        if (shuffle_ && options_.shardCount > 1 && options_.seed == 0) {
+            throw std::invalid_argument("Sharded shuffling needs a seed shared by all shards.");
+        }
+        if (options_.shuffleMode == ShuffleMode::Block &&
+            (options_.shuffleBlockSize == 0 || options_.shuffleWindowBlocks == 0)) {
+            throw std::invalid_argument("Block shuffling needs a non-zero block size and window.");
+        }
+        if (options_.readerThreads == 0) {
+            throw std::invalid_argument("DataLayer needs at least one reader thread.");
+        }
+        if (options_.shuffleMode == ShuffleMode::Importance &&
+            (options_.backend == DataBackend::Streaming || options_.importanceInitialScore <= 0.0 ||
+             options_.importanceFloor < 0.0)) {
+            throw std::invalid_argument("Importance sampling needs random access, a positive initial score "
+                                        "and a non-negative floor.");
+        }
+        if (options_.backend == DataBackend::Streaming &&
+            (options_.streamChunkSize == 0 || options_.shuffleBufferSize == 0)) {
+            throw std::invalid_argument("Streaming needs a non-zero chunk size and shuffle buffer.");
+        }
+        shuffleGen_.seed(options_.seed ? options_.seed : std::random_device{}());
+
         initialize();
-        if (shuffle_) {
+        if (shuffle_ && !streamer_) {
             shuffleIndices();
         }
+        if (options_.augmentation.enabled) {
+            uint64_t augmentSeed = mixSeed(options_.seed ? options_.seed : std::random_device{}()) + options_.shardId;
+            augmenter_ = std::make_unique<Augmenter>(imageRows_, imageCols_, batchSize_, options_.augmentation,
+                                                     augmentSeed);
+            augmented_.resize(batchSize_ * imageRows_ * imageCols_);
+            augmentedRows_.resize(batchSize_);
+        }
+        if (options_.prefetchDepth > 0) {
+            startPrefetching();
+        }
     }
 
-    // Function to fetch the next batch of data
-    std::pair<MatrixType<ComponentType>, MatrixType<ComponentType>> next() {
-        size_t numRows = imageRows_;
-        size_t numCols = imageCols_;
-        size_t flattenedSize = numRows * numCols;
+    // The prefetch thread refers back to this object, so it can be neither copied nor moved
+    DataLayer(const DataLayer&) = delete;
+    DataLayer& operator=(const DataLayer&) = delete;
 
-        // Initialize matrices for the batch
-        MatrixType<ComponentType> batchImages(batchSize_, flattenedSize);
-        MatrixType<ComponentType> batchLabels(batchSize_, 10); // One-hot encoded labels
-
-        for (size_t i = 0; i < batchSize_; ++i) {
-            if (currentIndex_ >= numImages_) {
-                currentIndex_ = 0;
-                if (shuffle_) {
-                    shuffleIndices();
-                }
+    ~DataLayer() override {
+        if (worker_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
             }
+            slotFree_.notify_all();
+            worker_.join();
+        }
+    }
 
-            size_t index = indices_[currentIndex_];
-            MatrixType<ComponentType> image = readMNISTImage(index);
-            batchImages.row(i) = Eigen::Map<Eigen::RowVectorX<ComponentType>>(image.data(), flattenedSize);
+    // Fetch the next batch into caller-owned buffers, with one class index per sample.
+    // Buffers that already have the batch shape are reused (or exchanged with a
+    // prefetched slot), so the steady state does not allocate.
+    void next(Matrix& batchImages, LabelVector& batchLabels) override {
+        if (options_.prefetchDepth == 0) {
+            loadBatch(batchImages, batchLabels, servedIndices_);
+            advanceEpochPosition(batchLabels.size());
+            return;
+        }
 
-            batchLabels.row(i).setZero();
-            batchLabels(i, readMNISTLabel(index)) = static_cast<ComponentType>(1.0);
+        // Wait for the prefetch thread to fill the oldest slot
+        std::unique_lock<std::mutex> lock(mutex_);
+        batchReady_.wait(lock, [this] { return filledSlots_ > 0 || prefetchError_; });
+        if (filledSlots_ == 0) {
+            std::rethrow_exception(prefetchError_);
+        }
+        lock.unlock();
 
-            ++currentIndex_;
+        // The producer does not touch a filled slot, so it can be read without the lock.
+        // Matching buffers are swapped so the caller's old ones go back into the ring.
+        Batch& slot = ring_[readSlot_];
+        if (sameShape(batchImages, slot.images) && sameShape(batchLabels, slot.labels)) {
+            batchImages.swap(slot.images);
+            batchLabels.swap(slot.labels);
+        } else {
+            batchImages = slot.images;
+            batchLabels = slot.labels;
+        }
+        servedIndices_.swap(slot.indices);
+
+        lock.lock();
+        readSlot_ = (readSlot_ + 1) % ring_.size();
+        --filledSlots_;
+        lock.unlock();
+        slotFree_.notify_one();
+        advanceEpochPosition(batchLabels.size());
+    }
+
+    // Same, with the labels expanded to dense one-hot rows of numClasses() columns
+    void next(Matrix& batchImages, Matrix& batchLabels) {
+        next(batchImages, classIndices_);
+        batchLabels.setZero(classIndices_.size(), numClasses_);
+        for (Eigen::Index i = 0; i < classIndices_.size(); ++i) {
+            batchLabels(i, classIndices_(i)) = static_cast<ComponentType>(1.0);
+        }
+    }
+
+    // Epoch iterator: fetch the next batch of the current epoch, or return false once all
+    // of its batches have been served (the following call starts the next epoch). Every
+    // sample of the epoch is visited exactly once, so partialFinalBatch must be set. When
+    // plain next() calls have left an epoch half served, its rest is skipped first.
+    template<typename Labels>
+    bool nextInEpoch(Matrix& batchImages, Labels& batchLabels) {
+        if (!options_.partialFinalBatch) {
+            throw std::logic_error("Epoch iteration needs partialFinalBatch, so that no batch spans two epochs.");
+        }
+        if (epochBatchesServed_ == batchesPerEpoch()) {
+            epochBatchesServed_ = 0;
+            return false;
+        }
+        if (epochBatchesServed_ == 0 && epochSamplesServed_ != 0) {
+            skipToEpochStart();
+        }
+        next(batchImages, batchLabels);
+        ++epochBatchesServed_;
+        return true;
+    }
+
+    size_t batchesPerEpoch() const {
+        size_t epochSize = shardEnd_ - shardBegin_;
+        return options_.partialFinalBatch ? (epochSize + batchSize_ - 1) / batchSize_ : epochSize / batchSize_;
+    }
+
+    // Importance sampling feedback: the loss of every sample of the batch served last
+    void reportLosses(const Eigen::Ref<const Eigen::VectorX<ComponentType>>& losses) override {
+        if (options_.shuffleMode != ShuffleMode::Importance || !shuffle_) {
+            return;
         }
+        if (static_cast<size_t>(losses.size()) != servedIndices_.size()) {
+            throw std::invalid_argument("Expected one loss per sample of the last batch.");
+        }
+
+        std::lock_guard<std::mutex> lock(scoresMutex_);
+        for (size_t i = 0; i < servedIndices_.size(); ++i) {
+            double loss = std::max(static_cast<double>(losses(i)), 0.0);
+            scores_.update(servedIndices_[i] - shardBegin_, loss + options_.importanceFloor);
+        }
+    }
 
-        return {batchImages, batchLabels};
+    size_t numClasses() const override {
+        return numClasses_;
+    }
+
+    size_t sampleSize() const override {
+        return imageRows_ * imageCols_;
+    }
+
+    // Bytes one sample takes in its source, before it is converted to ComponentType
+    size_t sourceSampleBytes() const {
+        bool normalized = reader_ && reader_->isNormalized();
+        return sampleSize() * (normalized ? sizeof(float) : sizeof(uint8_t));
+    }
+
+    // Function to fetch the next batch of data
+    std::pair<Matrix, Matrix> next() {
+        std::pair<Matrix, Matrix> batch;
+        next(batch.first, batch.second);
+        return batch;
+    }
+
+    // One epoch as a coroutine pipeline, read -> augment -> normalize and batch. Reads
+    // spread each batch worth of samples over `threads` OpenMP workers on a thread of
+    // their own, up to queueDepth batches ahead of augmentation. Batches are assembled on
+    // a second producer thread that runs at most queueDepth batches ahead of the consumer,
+    // so reading, assembling and training overlap. Serves the same epochs in the same
+    // order as nextInEpoch(), but must not run alongside next() on the same layer.
+    // Importance sampling needs the served indices for its loss feedback, so it is not
+    // supported here.
+    Generator<std::pair<Matrix, LabelVector>> epochPipeline(size_t threads = 1, size_t queueDepth = 2) {
+        if (options_.prefetchDepth > 0 || streamer_) {
+            throw std::logic_error("The epoch pipeline needs a random-access backend without prefetching.");
+        }
+        if (shuffle_ && options_.shuffleMode == ShuffleMode::Importance) {
+            throw std::logic_error("The epoch pipeline does not support importance sampling.");
+        }
+        if (threads == 0 || queueDepth == 0) {
+            throw std::invalid_argument("The epoch pipeline needs at least one thread and one queued batch.");
+        }
+        // An untouched epoch keeps its order, so the constructor's shuffle is not thrown away.
+        // The pipeline serves the whole epoch, so whatever comes next starts a new one.
+        if (currentIndex_ != shardBegin_) {
+            startEpoch();
+        }
+        currentIndex_ = shardEnd_;
+        epochSamplesServed_ = 0;
+
+        auto pixelPool = std::make_shared<BufferPool<uint8_t>>(imageRows_ * imageCols_);
+        auto read = mapStage(epochOrder(), [this, pixelPool](size_t index) {
+            return readSample(index, *pixelPool);
+        }, threads, batchSize_);
+        auto fetched = threadStage(std::move(read), queueDepth * batchSize_);
+        auto augmented = augmenter_ ? augmentStage(std::move(fetched)) : std::move(fetched);
+        return threadStage(batchStage(std::move(augmented)), queueDepth);
     }
 
 private:
@@ -67,17 +473,438 @@ private:
     std::string labelFile_;
     size_t batchSize_;
     bool shuffle_;
+    DataLayerOptions options_;
     size_t currentIndex_;
     size_t numImages_;
     size_t imageRows_, imageCols_;
+    size_t numClasses_;
     std::vector<size_t> indices_; // Stores indices for shuffling
+    size_t shardBegin_, shardEnd_; // Positions in indices_ served by this shard
+    std::mt19937 shuffleGen_;
+    std::vector<size_t> blockOrder_; // Block permutation used by ShuffleMode::Block
+    FeistelPermutation permutation_; // Epoch order used by ShuffleMode::Feistel in place of indices_
+    ScoreSampler scores_;            // Per-sample scores of this shard for ShuffleMode::Importance
+    std::mutex scoresMutex_;         // Guards scores_ between the prefetch thread and reportLosses()
+    std::vector<size_t> servedIndices_; // Sample indices of the batch handed out last
+    size_t epochBatchesServed_ = 0;  // Batches handed out by nextInEpoch() in the current epoch
+    size_t epochSamplesServed_ = 0;  // Samples of the current epoch handed out by next()
+    std::shared_ptr<IdxReader> reader_;
+    std::unique_ptr<ShuffleBufferIdxStream> streamer_; // Replaces reader_ and indices_ when streaming
+    std::vector<uint8_t> scratch_; // Pixel buffers for backends that copy samples out, one per batch row
+    std::vector<const uint8_t*> samplePixels_; // Pixels of each sample in the batch being assembled
+    std::vector<const float*> sampleValues_;   // Same, for backends that store normalized floats
+    std::unique_ptr<Augmenter> augmenter_;
+    std::vector<float> augmented_;              // Warped images of the batch being assembled
+    std::vector<const float*> augmentedRows_;
+    LabelVector classIndices_; // Labels of the last batch served as one-hot rows
+
+    // Ring of preallocated batches filled ahead of time by the prefetch thread
+    struct Batch {
+        Matrix images;
+        LabelVector labels;
+        std::vector<size_t> indices;
+    };
+    std::vector<Batch> ring_;
+    size_t readSlot_ = 0;
+    size_t writeSlot_ = 0;
+    size_t filledSlots_ = 0;
+    bool stopping_ = false;
+    std::exception_ptr prefetchError_;
+    std::mutex mutex_;
+    std::condition_variable batchReady_;
+    std::condition_variable slotFree_;
+    std::thread worker_;
+
+    // Assemble a batch into images and labels, resizing them only if their shape differs
+    void loadBatch(Matrix& batchImages, LabelVector& batchLabels,
+                   std::vector<size_t>& batchIndices) {
+        size_t numRows = imageRows_;
+        size_t numCols = imageCols_;
+        size_t flattenedSize = numRows * numCols;
+
+        // The final batch of an epoch may be smaller than batchSize_
+        if (currentIndex_ >= shardEnd_) {
+            startEpoch();
+        }
+        size_t batchRows = batchSize_;
+        if (options_.partialFinalBatch) {
+            batchRows = std::min(batchRows, shardEnd_ - currentIndex_);
+        }
+
+        batchImages.resize(batchRows, flattenedSize);
+        batchLabels.resize(batchRows);
+        batchIndices.resize(streamer_ ? 0 : batchRows);
+
+        // Gather the pixels of every sample first, then convert the whole batch at once
+        bool normalized = reader_ && reader_->isNormalized();
+        std::unique_lock<std::mutex> scoresLock(scoresMutex_, std::defer_lock);
+        bool importance = shuffle_ && options_.shuffleMode == ShuffleMode::Importance;
+        if (importance) {
+            scoresLock.lock();
+        }
+        for (size_t i = 0; i < batchRows; ++i) {
+            if (currentIndex_ >= shardEnd_) {
+                startEpoch();
+            }
+
+            if (streamer_) {
+                uint8_t* pixels = scratch_.data() + i * flattenedSize;
+                samplePixels_[i] = pixels;
+                batchLabels(i) = checkedLabel(streamer_->next(pixels, shuffle_ ? &shuffleGen_ : nullptr));
+            } else if (importance) {
+                batchIndices[i] = shardBegin_ + scores_.sample(shuffleGen_);
+            } else {
+                batchIndices[i] = sampleIndex(currentIndex_);
+            }
+            ++currentIndex_;
+        }
+        if (importance) {
+            scoresLock.unlock();
+        }
+
+        // Every row has its own scratch buffer, so the samples can be read concurrently
+        if (!streamer_) {
+            std::exception_ptr error;
+            #pragma omp parallel for schedule(dynamic, 1) num_threads(options_.readerThreads) \
+                if (options_.readerThreads > 1)
+            for (long i = 0; i < static_cast<long>(batchRows); ++i) {
+                try {
+                    size_t index = batchIndices[i];
+                    if (normalized) {
+                        sampleValues_[i] = reader_->normalizedImage(index);
+                    } else {
+                        samplePixels_[i] = reader_->image(index, scratch_.data() + i * flattenedSize);
+                    }
+                    batchLabels(i) = checkedLabel(readMNISTLabel(index));
+                } catch (...) {
+                    #pragma omp critical
+                    error = std::current_exception();
+                }
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        // Augmentation keeps the units of the source, so the scale does not change
+        auto scale = static_cast<ComponentType>(normalized ? 1.0 : 1.0 / 255.0);
+        if (augmenter_) {
+            if (normalized) {
+                augmenter_->apply(sampleValues_.data(), augmented_.data(), batchRows);
+            } else {
+                augmenter_->apply(samplePixels_.data(), augmented_.data(), batchRows);
+            }
+            for (size_t i = 0; i < batchRows; ++i) {
+                augmentedRows_[i] = augmented_.data() + i * flattenedSize;
+            }
+            writeBatch(augmentedRows_.data(), batchRows, flattenedSize, batchImages, scale);
+        } else if (normalized) {
+            writeBatch(sampleValues_.data(), batchRows, flattenedSize, batchImages, scale);
+        } else {
+            writeBatch(samplePixels_.data(), batchRows, flattenedSize, batchImages, scale);
+        }
+    }
+
+    // Count the samples handed out, wrapping at the end of every epoch
+    void advanceEpochPosition(size_t samples) {
+        epochSamplesServed_ = (epochSamplesServed_ + samples) % (shardEnd_ - shardBegin_);
+    }
+
+    // Drop what is left of the epoch that plain next() calls have started
+    void skipToEpochStart() {
+        if (options_.prefetchDepth == 0) {
+            // Nothing is loaded ahead, so the next batch can start a new epoch right away
+            currentIndex_ = shardEnd_;
+            epochSamplesServed_ = 0;
+            return;
+        }
+
+        // The prefetch thread has loaded the rest of the epoch already; serve and discard it
+        Matrix images;
+        LabelVector labels;
+        while (epochSamplesServed_ != 0) {
+            next(images, labels);
+        }
+    }
+
+    void startEpoch() {
+        currentIndex_ = shardBegin_;
+        if (streamer_) {
+            streamer_->rewind();
+        } else if (shuffle_) {
+            shuffleIndices();
+        }
+    }
+
+    // Pipeline stages
+
+    Generator<size_t> epochOrder() {
+        for (size_t position = shardBegin_; position < shardEnd_; ++position) {
+            co_yield sampleIndex(position);
+        }
+    }
+
+    // Sources that map or preload their samples are addressed in place; the others copy
+    // the sample into a pooled buffer
+    PipelineSample readSample(size_t index, BufferPool<uint8_t>& pixelPool) {
+        PipelineSample sample;
+        sample.index = index;
+        sample.label = checkedLabel(readMNISTLabel(index));
+        if (reader_->isNormalized()) {
+            sample.values = reader_->normalizedImage(index);
+        } else {
+            sample.pixelBuffer = pixelPool.acquire();
+            sample.pixels = reader_->image(index, sample.pixelBuffer.data());
+            if (sample.pixels != sample.pixelBuffer.data()) {
+                sample.pixelBuffer = {};
+            }
+        }
+        return sample;
+    }
+
+    // The augmenter works a batch at a time, so samples are warped in groups of batchSize_
+    Generator<PipelineSample> augmentStage(Generator<PipelineSample> samples) {
+        size_t imageSize = imageRows_ * imageCols_;
+        auto valuePool = std::make_shared<BufferPool<float>>(imageSize);
+        std::vector<PipelineSample> group;
+        std::vector<const uint8_t*> pixelRows;
+        std::vector<const float*> valueRows;
+        auto it = samples.begin();
+        while (it != samples.end()) {
+            group.clear();
+            pixelRows.clear();
+            valueRows.clear();
+            for (; it != samples.end() && group.size() < batchSize_; ++it) {
+                group.push_back(std::move(*it));
+                pixelRows.push_back(group.back().pixels);
+                valueRows.push_back(group.back().values);
+            }
+            if (reader_->isNormalized()) {
+                augmenter_->apply(valueRows.data(), augmented_.data(), group.size());
+            } else {
+                augmenter_->apply(pixelRows.data(), augmented_.data(), group.size());
+            }
+
+            // Warped values keep the units of the source, so the batch scale does not change
+            for (size_t i = 0; i < group.size(); ++i) {
+                PipelineSample& sample = group[i];
+                sample.valueBuffer = valuePool->acquire();
+                const float* warped = augmented_.data() + i * imageSize;
+                std::copy(warped, warped + imageSize, sample.valueBuffer.data());
+                sample.values = sample.valueBuffer.data();
+                sample.pixels = nullptr;
+                sample.pixelBuffer = {};
+                co_yield std::move(sample);
+            }
+        }
+    }
+
+    // Full batches of the epoch, plus the remainder when partialFinalBatch is set
+    Generator<std::pair<Matrix, LabelVector>> batchStage(Generator<PipelineSample> samples) {
+        std::vector<PipelineSample> pending;
+        pending.reserve(batchSize_);
+        for (auto it = samples.begin(); it != samples.end(); ++it) {
+            pending.push_back(std::move(*it));
+            if (pending.size() == batchSize_) {
+                co_yield assembleBatch(pending);
+                pending.clear();
+            }
+        }
+        if (!pending.empty() && options_.partialFinalBatch) {
+            co_yield assembleBatch(pending);
+        }
+    }
+
+    // Widen and scale the samples into a batch with the same kernel and scale as next()
+    std::pair<Matrix, LabelVector> assembleBatch(const std::vector<PipelineSample>& samples) {
+        size_t imageSize = imageRows_ * imageCols_;
+        std::pair<Matrix, LabelVector> batch;
+        batch.first.resize(samples.size(), imageSize);
+        batch.second.resize(samples.size());
+        for (size_t i = 0; i < samples.size(); ++i) {
+            samplePixels_[i] = samples[i].pixels;
+            sampleValues_[i] = samples[i].values;
+            batch.second(i) = samples[i].label;
+        }
+
+        // A batch holds samples of one kind: all pixels, or all values
+        auto scale = static_cast<ComponentType>(reader_->isNormalized() ? 1.0 : 1.0 / 255.0);
+        if (samples.front().values) {
+            writeBatch(sampleValues_.data(), samples.size(), imageSize, batch.first, scale);
+        } else {
+            writeBatch(samplePixels_.data(), samples.size(), imageSize, batch.first, scale);
+        }
+        return batch;
+    }
+
+    // Widen and scale the samples into the rows of a batch, in the batch's storage order
+    template<typename Source>
+    static void writeBatch(const Source* const* samples, size_t count, size_t width, Matrix& batch,
+                           ComponentType scale) {
+        if constexpr (StorageOrder == Eigen::RowMajor) {
+            normalizeBatchRows<ComponentType>(samples, count, width, batch.data(), batch.outerStride(), scale);
+        } else {
+            normalizeBatch<ComponentType>(samples, count, width, batch.data(), batch.outerStride(), scale);
+        }
+    }
+
+    int32_t checkedLabel(int32_t label) const {
+        if (label < 0 || static_cast<size_t>(label) >= numClasses_) {
+            throw std::runtime_error("Label " + std::to_string(label) + " is out of range for " +
+                                     std::to_string(numClasses_) + " classes.");
+        }
+        return label;
+    }
+
+    template<typename Buffer>
+    static bool sameShape(const Buffer& a, const Buffer& b) {
+        return a.rows() == b.rows() && a.cols() == b.cols();
+    }
+
+    void startPrefetching() {
+        ring_.resize(options_.prefetchDepth);
+        for (Batch& slot : ring_) {
+            slot.images.resize(batchSize_, imageRows_ * imageCols_);
+            slot.labels.resize(batchSize_);
+        }
+        worker_ = std::thread(&DataLayer::prefetchLoop, this);
+    }
+
+    // Keep every free slot of the ring filled until the layer is destroyed
+    void prefetchLoop() {
+        try {
+            while (true) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                slotFree_.wait(lock, [this] { return filledSlots_ < ring_.size() || stopping_; });
+                if (stopping_) {
+                    return;
+                }
+                lock.unlock();
+
+                Batch& slot = ring_[writeSlot_];
+                loadBatch(slot.images, slot.labels, slot.indices);
+
+                lock.lock();
+                writeSlot_ = (writeSlot_ + 1) % ring_.size();
+                ++filledSlots_;
+                lock.unlock();
+                batchReady_.notify_one();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            prefetchError_ = std::current_exception();
+            batchReady_.notify_all();
+        }
+    }
 
     // Initialize dataset by reading headers
     void initialize() {
+        if (options_.backend == DataBackend::Cache) {
+            // The cache file carries its own header and labels
+            auto cache = std::make_shared<CachedReader>(imageFile_, !shuffle_);
+            numImages_ = cache->numImages();
+            imageRows_ = cache->rows();
+            imageCols_ = cache->cols();
+            if (cache->numClasses() != options_.numClasses) {
+                throw std::runtime_error("Cache file " + imageFile_ + " has " + std::to_string(cache->numClasses()) +
+                                         " classes, but " + std::to_string(options_.numClasses) +
+                                         " are configured.");
+            }
+            numClasses_ = options_.numClasses;
+            reader_ = cache;
+        } else if (options_.backend == DataBackend::Csv) {
+            // Tabular samples are single rows of features
+            auto csv = std::make_shared<CsvReader>(imageFile_, options_.numClasses);
+            numImages_ = csv->numImages();
+            imageRows_ = 1;
+            imageCols_ = csv->imageSize();
+            numClasses_ = options_.numClasses;
+            reader_ = csv;
+        } else if (options_.backend == DataBackend::RawFloat) {
+            auto raw = std::make_shared<RawFloatReader>(imageFile_, !shuffle_);
+            numImages_ = raw->numImages();
+            imageRows_ = 1;
+            imageCols_ = raw->imageSize();
+            numClasses_ = raw->numClasses();
+            reader_ = raw;
+        } else {
+            openIdxDataset();
+            numClasses_ = options_.numClasses;
+        }
+
+        // Equal-sized shards keep data-parallel workers in lockstep; the up to
+        // shardCount - 1 samples left over are skipped for the epoch
+        size_t shardSize = numImages_ / options_.shardCount;
+        if (shardSize == 0) {
+            throw std::runtime_error("Dataset has fewer images than shards.");
+        }
+        shardBegin_ = options_.shardId * shardSize;
+        shardEnd_ = shardBegin_ + shardSize;
+        currentIndex_ = shardBegin_;
+
+        // Streaming and Feistel shuffling keep no per-sample state, so memory does not
+        // grow with numImages_
+        if (options_.backend == DataBackend::Streaming) {
+            streamer_ = std::make_unique<ShuffleBufferIdxStream>(
+                imageFile_, labelFile_, imageRows_ * imageCols_, shardBegin_, shardEnd_,
+                options_.streamChunkSize, options_.shuffleBufferSize);
+        } else if (options_.shuffleMode == ShuffleMode::Importance) {
+            // Samples are drawn from this shard's slice, each shard scoring its own samples
+            scores_ = ScoreSampler(shardEnd_ - shardBegin_, options_.importanceInitialScore);
+        } else if (options_.shuffleMode != ShuffleMode::Feistel) {
+            indices_.resize(numImages_);
+            std::iota(indices_.begin(), indices_.end(), 0);
+        }
+
+        size_t imageSize = imageRows_ * imageCols_;
+        scratch_.resize(batchSize_ * imageSize);
+        samplePixels_.resize(batchSize_);
+        sampleValues_.resize(batchSize_);
+    }
+
+    // Open the IDX file pair, or the list of file pairs that together make up the dataset
+    void openIdxDataset() {
+        std::vector<std::string> imageFiles = expandDatasetPaths(imageFile_);
+        std::vector<std::string> labelFiles = expandDatasetPaths(labelFile_);
+        if (imageFiles.size() != labelFiles.size()) {
+            throw std::runtime_error("Mismatch between number of image and label files.");
+        }
+
+        if (imageFiles.size() == 1) {
+            imageFile_ = imageFiles[0];
+            labelFile_ = labelFiles[0];
+            numImages_ = readIdxHeaders(imageFile_, labelFile_);
+            reader_ = openIdxReader(imageFile_, labelFile_, numImages_);
+            return;
+        }
+
+        if (options_.backend == DataBackend::Streaming) {
+            throw std::invalid_argument("The streaming backend reads a single file pair.");
+        }
+
+        // Shards are addressed through one global index, in the order they were listed
+        std::vector<std::shared_ptr<IdxReader>> shards;
+        size_t numRows = 0, numCols = 0;
+        for (size_t k = 0; k < imageFiles.size(); ++k) {
+            size_t count = readIdxHeaders(imageFiles[k], labelFiles[k]);
+            if (k > 0 && (imageRows_ != numRows || imageCols_ != numCols)) {
+                throw std::runtime_error("Image size of " + imageFiles[k] + " differs from the first shard.");
+            }
+            numRows = imageRows_;
+            numCols = imageCols_;
+            shards.push_back(openIdxReader(imageFiles[k], labelFiles[k], count));
+        }
+        reader_ = std::make_shared<ShardedIdxReader>(std::move(shards), numRows * numCols);
+        numImages_ = reader_->numImages();
+    }
+
+    // Read and check the headers of one image/label file pair. Sets the image shape and
+    // returns the number of samples.
+    size_t readIdxHeaders(const std::string& imageFile, const std::string& labelFile) {
         // Read the image file header
-        std::ifstream imageStream(imageFile_, std::ios::binary);
+        std::ifstream imageStream(imageFile, std::ios::binary);
         if (!imageStream.is_open()) {
-            throw std::runtime_error("Failed to open image file: " + imageFile_);
+            throw std::runtime_error("Failed to open image file: " + imageFile);
         }
 
         uint32_t magicNumber, numImages, numRows, numCols;
@@ -95,16 +922,13 @@ private:
             throw std::runtime_error("Invalid magic number in image file.");
         }
 
-        numImages_ = numImages;
         imageRows_ = numRows;
         imageCols_ = numCols;
-        indices_.resize(numImages_);
-        std::iota(indices_.begin(), indices_.end(), 0);
 
         // Verify the label file
-        std::ifstream labelStream(labelFile_, std::ios::binary);
+        std::ifstream labelStream(labelFile, std::ios::binary);
         if (!labelStream.is_open()) {
-            throw std::runtime_error("Failed to open label file: " + labelFile_);
+            throw std::runtime_error("Failed to open label file: " + labelFile);
         }
 
         uint32_t labelMagicNumber, numLabels;
@@ -118,56 +942,88 @@ private:
             throw std::runtime_error("Invalid magic number in label file.");
         }
 
-        if (numImages_ != numLabels) {
+        if (numImages != numLabels) {
             throw std::runtime_error("Mismatch between number of images and labels.");
         }
+        return numImages;
     }
 
-    // Shuffle indices for randomized access
-    void shuffleIndices() {
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(indices_.begin(), indices_.end(), g);
+    // Open the storage backend for one file pair once its layout is known
+    std::shared_ptr<IdxReader> openIdxReader(const std::string& imageFile, const std::string& labelFile,
+                                             size_t numImages) {
+        size_t imageSize = imageRows_ * imageCols_;
+        switch (options_.backend) {
+        case DataBackend::Stream:
+            return std::make_shared<StreamIdxReader>(imageFile, labelFile, numImages, imageSize);
+        case DataBackend::MemoryMapped:
+            return std::make_shared<MappedIdxReader>(imageFile, labelFile, numImages, imageSize, !shuffle_);
+        case DataBackend::Preload:
+            return std::make_shared<PreloadedIdxReader>(imageFile, labelFile, numImages, imageSize);
+        case DataBackend::Cache:
+        case DataBackend::Streaming:
+        case DataBackend::Csv:
+        case DataBackend::RawFloat:
+            break;
+        }
+        return nullptr;
     }
 
-    // Helper function to read an MNIST image
-    MatrixType<ComponentType> readMNISTImage(size_t imageIndex) {
-        // Open the image file
-        std::ifstream file(imageFile_, std::ios::binary);
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to open file: " + imageFile_);
+    // Sample served at a position of the epoch order
+    size_t sampleIndex(size_t position) const {
+        if (options_.shuffleMode == ShuffleMode::Feistel) {
+            return shuffle_ ? permutation_(position) : position;
         }
+        if (options_.shuffleMode == ShuffleMode::Importance) {
+            // Shuffled importance epochs draw from the score sampler instead of a fixed order
+            if (shuffle_) {
+                throw std::logic_error("Importance sampling has no fixed epoch order.");
+            }
+            return position;
+        }
+        return indices_[position];
+    }
 
-        // Seek to the specific image location
-        file.seekg(16 + imageIndex * imageRows_ * imageCols_, std::ios::beg);
-
-        // Read raw image data into a buffer
-        std::vector<uint8_t> buffer(imageRows_ * imageCols_);
-        file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
-
-        // Map the buffer to an Eigen matrix of type uint8_t
-        Eigen::Map<Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> 
-            rawImage(buffer.data(), imageRows_, imageCols_);
-
-        // Convert to the desired type and normalize
-        MatrixType<ComponentType> image = rawImage.cast<ComponentType>() / static_cast<ComponentType>(255.0);
-
-        return image;
-}
+    // Shuffle indices for randomized access
+    // The whole index space is permuted, so shards seeded alike agree on every epoch
+    void shuffleIndices() {
+        if (options_.shuffleMode == ShuffleMode::Importance) {
+            return; // Every draw is random already
+        }
+        if (options_.shuffleMode == ShuffleMode::Feistel) {
+            // O(1) per epoch: only the key changes
+            permutation_ = FeistelPermutation(numImages_, shuffleGen_());
+            return;
+        }
+        if (options_.shuffleMode == ShuffleMode::Full) {
+            std::shuffle(indices_.begin(), indices_.end(), shuffleGen_);
+            return;
+        }
 
+        // Lay out the blocks in random order, each block still sequential on disk
+        size_t blockSize = options_.shuffleBlockSize;
+        size_t numBlocks = (numImages_ + blockSize - 1) / blockSize;
+        blockOrder_.resize(numBlocks);
+        std::iota(blockOrder_.begin(), blockOrder_.end(), 0);
+        std::shuffle(blockOrder_.begin(), blockOrder_.end(), shuffleGen_);
 
-    // Helper function to read an MNIST label
-    uint8_t readMNISTLabel(size_t labelIndex) {
-        std::ifstream file(labelFile_, std::ios::binary);
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to open file: " + labelFile_);
+        auto out = indices_.begin();
+        for (size_t block : blockOrder_) {
+            size_t first = block * blockSize;
+            size_t last = std::min(first + blockSize, numImages_);
+            std::iota(out, out + (last - first), first);
+            out += last - first;
         }
 
-        file.seekg(8 + labelIndex, std::ios::beg);
-
-        uint8_t label;
-        file.read(reinterpret_cast<char*>(&label), sizeof(label));
+        // Then mix the samples of a few neighbouring blocks
+        size_t windowSize = blockSize * options_.shuffleWindowBlocks;
+        for (size_t first = 0; first < numImages_; first += windowSize) {
+            size_t last = std::min(first + windowSize, numImages_);
+            std::shuffle(indices_.begin() + first, indices_.begin() + last, shuffleGen_);
+        }
+    }
 
-        return label;
+    // Helper function to read an MNIST label
+    int32_t readMNISTLabel(size_t labelIndex) {
+        return reader_->label(labelIndex);
     }
 };
\ No newline at end of file
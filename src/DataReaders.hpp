@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Interface over the raw storage of an IDX image/label file pair
+class IdxReader {
+public:
+    IdxReader(size_t numImages, size_t imageSize) : numImages_(numImages), imageSize_(imageSize) {}
+    virtual ~IdxReader() = default;
+
+    // Returns the pixels of an image. The pointer either addresses the backing storage
+    // directly or points into scratch, which must hold at least imageSize() bytes.
+    virtual const uint8_t* image(size_t imageIndex, uint8_t* scratch) = 0;
+
+    // Returns the class index of a sample
+    virtual int32_t label(size_t labelIndex) = 0;
+
+    // Backends that store ready-to-use floats (pixels scaled to [0, 1], or tabular
+    // features) serve them through normalizedImage()
+    virtual bool isNormalized() const { return false; }
+    virtual const float* normalizedImage(size_t imageIndex) { return nullptr; }
+
+    size_t numImages() const { return numImages_; }
+    size_t imageSize() const { return imageSize_; }
+
+protected:
+    size_t numImages_;
+    size_t imageSize_;
+};
+
+// Reader that opens the files and seeks for every sample
+class StreamIdxReader : public IdxReader {
+public:
+    StreamIdxReader(const std::string& imageFile, const std::string& labelFile, size_t numImages, size_t imageSize)
+        : IdxReader(numImages, imageSize), imageFile_(imageFile), labelFile_(labelFile) {}
+
+    const uint8_t* image(size_t imageIndex, uint8_t* scratch) override {
+        // Open the image file
+        std::ifstream file(imageFile_, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file: " + imageFile_);
+        }
+
+        // Seek to the specific image location and read the raw pixels
+        file.seekg(16 + imageIndex * imageSize_, std::ios::beg);
+        file.read(reinterpret_cast<char*>(scratch), imageSize_);
+
+        return scratch;
+    }
+
+    int32_t label(size_t labelIndex) override {
+        std::ifstream file(labelFile_, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file: " + labelFile_);
+        }
+
+        file.seekg(8 + labelIndex, std::ios::beg);
+
+        uint8_t label;
+        file.read(reinterpret_cast<char*>(&label), sizeof(label));
+
+        return label;
+    }
+
+private:
+    std::string imageFile_;
+    std::string labelFile_;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile(const std::string& path, size_t minSize, bool sequential) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat file: " + path);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ < minSize) {
+            ::close(fd);
+            throw std::runtime_error("File is smaller than its header declares: " + path);
+        }
+
+        void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps its own reference to the file
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+        data_ = static_cast<const uint8_t*>(mapping);
+
+        // Read-ahead hints: fault the whole file in ahead of use, and let the kernel
+        // drop pages behind the cursor when the access pattern is sequential
+        ::madvise(mapping, size_, MADV_WILLNEED);
+        if (sequential) {
+            ::madvise(mapping, size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    ~MappedFile() {
+        ::munmap(const_cast<uint8_t*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Reader that maps both files once and addresses samples in place
+class MappedIdxReader : public IdxReader {
+public:
+    MappedIdxReader(const std::string& imageFile, const std::string& labelFile,
+                    size_t numImages, size_t imageSize, bool sequential)
+        : IdxReader(numImages, imageSize),
+          images_(imageFile, 16 + numImages * imageSize, sequential),
+          labels_(labelFile, 8 + numImages, sequential) {}
+
+    const uint8_t* image(size_t imageIndex, uint8_t* /*scratch*/) override {
+        return images_.data() + 16 + imageIndex * imageSize_;
+    }
+
+    int32_t label(size_t labelIndex) override {
+        return labels_.data()[8 + labelIndex];
+    }
+
+private:
+    MappedFile images_;
+    MappedFile labels_;
+};
+
+// Reader that loads both files into memory once and serves samples from there.
+// Pixels stay as uint8 so the footprint matches the file, not the ComponentType.
+class PreloadedIdxReader : public IdxReader {
+public:
+    PreloadedIdxReader(const std::string& imageFile, const std::string& labelFile,
+                       size_t numImages, size_t imageSize)
+        : IdxReader(numImages, imageSize),
+          images_(readPayload(imageFile, 16, numImages * imageSize)),
+          labels_(readPayload(labelFile, 8, numImages)) {}
+
+    const uint8_t* image(size_t imageIndex, uint8_t* /*scratch*/) override {
+        return images_.data() + imageIndex * imageSize_;
+    }
+
+    int32_t label(size_t labelIndex) override {
+        return labels_[labelIndex];
+    }
+
+private:
+    std::vector<uint8_t> images_;
+    std::vector<uint8_t> labels_;
+
+    // Read everything after the header in a single call
+    static std::vector<uint8_t> readPayload(const std::string& path, size_t headerSize, size_t payloadSize) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+
+        std::vector<uint8_t> payload(payloadSize);
+        file.seekg(headerSize, std::ios::beg);
+        file.read(reinterpret_cast<char*>(payload.data()), payloadSize);
+        if (static_cast<size_t>(file.gcount()) != payloadSize) {
+            throw std::runtime_error("File is smaller than its header declares: " + path);
+        }
+
+        return payload;
+    }
+};
+
+// Sequential reader over a contiguous range of an IDX file pair for datasets that do not
+// fit in memory. Samples are read in large chunks and served through a bounded shuffle
+// buffer, so memory stays at (chunkSize + bufferSize) samples however large the files are.
+class ShuffleBufferIdxStream {
+public:
+    ShuffleBufferIdxStream(const std::string& imageFile, const std::string& labelFile, size_t imageSize,
+                           size_t first, size_t last, size_t chunkSize, size_t bufferSize)
+        : imageSize_(imageSize), first_(first), last_(last), chunkSize_(chunkSize), bufferSize_(bufferSize),
+          images_(imageFile, std::ios::binary), labels_(labelFile, std::ios::binary),
+          chunkPixels_(chunkSize * imageSize), chunkLabels_(chunkSize),
+          bufferPixels_(bufferSize * imageSize), bufferLabels_(bufferSize) {
+        if (!images_.is_open()) {
+            throw std::runtime_error("Failed to open file: " + imageFile);
+        }
+        if (!labels_.is_open()) {
+            throw std::runtime_error("Failed to open file: " + labelFile);
+        }
+        rewind();
+    }
+
+    // Restart at the beginning of the range with an empty buffer
+    void rewind() {
+        position_ = first_;
+        chunkBegin_ = chunkEnd_ = 0;
+        filled_ = 0;
+        images_.clear();
+        labels_.clear();
+        images_.seekg(16 + first_ * imageSize_, std::ios::beg);
+        labels_.seekg(8 + first_, std::ios::beg);
+    }
+
+    // Copy the next sample into pixels and return its label. With a generator the sample is
+    // drawn at random from the shuffle buffer, otherwise samples come in file order.
+    template<typename Generator>
+    uint8_t next(uint8_t* pixels, Generator* gen) {
+        const uint8_t* src;
+        uint8_t label;
+        if (!gen) {
+            if (!pull(src, label)) {
+                throw std::out_of_range("Read past the end of the streamed range.");
+            }
+            std::copy(src, src + imageSize_, pixels);
+            return label;
+        }
+
+        // Top the buffer up from the file, then serve a random slot and fill the hole
+        // with the last slot
+        while (filled_ < bufferSize_ && pull(src, label)) {
+            std::copy(src, src + imageSize_, bufferPixels_.begin() + filled_ * imageSize_);
+            bufferLabels_[filled_++] = label;
+        }
+        if (filled_ == 0) {
+            throw std::out_of_range("Read past the end of the streamed range.");
+        }
+
+        size_t slot = std::uniform_int_distribution<size_t>(0, filled_ - 1)(*gen);
+        auto slotPixels = bufferPixels_.begin() + slot * imageSize_;
+        std::copy(slotPixels, slotPixels + imageSize_, pixels);
+        label = bufferLabels_[slot];
+
+        --filled_;
+        auto lastPixels = bufferPixels_.begin() + filled_ * imageSize_;
+        std::copy(lastPixels, lastPixels + imageSize_, slotPixels);
+        bufferLabels_[slot] = bufferLabels_[filled_];
+
+        return label;
+    }
+
+private:
+    size_t imageSize_;
+    size_t first_, last_;
+    size_t chunkSize_, bufferSize_;
+    std::ifstream images_;
+    std::ifstream labels_;
+    size_t position_;                   // Next sample to read from the files
+    std::vector<uint8_t> chunkPixels_;  // Last chunk read from the files
+    std::vector<uint8_t> chunkLabels_;
+    size_t chunkBegin_, chunkEnd_;      // Unserved part of the chunk
+    std::vector<uint8_t> bufferPixels_; // Shuffle buffer
+    std::vector<uint8_t> bufferLabels_;
+    size_t filled_;
+
+    // Next sample in file order, reading a new chunk when the current one is used up
+    bool pull(const uint8_t*& pixels, uint8_t& label) {
+        if (chunkBegin_ == chunkEnd_) {
+            size_t count = std::min(chunkSize_, last_ - position_);
+            if (count == 0) {
+                return false;
+            }
+            images_.read(reinterpret_cast<char*>(chunkPixels_.data()), count * imageSize_);
+            labels_.read(reinterpret_cast<char*>(chunkLabels_.data()), count);
+            if (!images_ || !labels_) {
+                throw std::runtime_error("File is smaller than its header declares.");
+            }
+            position_ += count;
+            chunkBegin_ = 0;
+            chunkEnd_ = count;
+        }
+
+        pixels = chunkPixels_.data() + chunkBegin_ * imageSize_;
+        label = chunkLabels_[chunkBegin_++];
+        return true;
+    }
+};
+
+// Several IDX file pairs presented as one dataset. Global index i addresses the shard
+// whose range [firstIndex, firstIndex + numImages) contains it. The shard readers are
+// independent of each other, so samples from different shards can be read concurrently.
+class ShardedIdxReader : public IdxReader {
+public:
+    ShardedIdxReader(std::vector<std::shared_ptr<IdxReader>> shards, size_t imageSize)
+        : IdxReader(0, imageSize), shards_(std::move(shards)) {
+        firstIndex_.push_back(0);
+        for (const auto& shard : shards_) {
+            firstIndex_.push_back(firstIndex_.back() + shard->numImages());
+        }
+        numImages_ = firstIndex_.back();
+    }
+
+    const uint8_t* image(size_t imageIndex, uint8_t* scratch) override {
+        size_t shard = locate(imageIndex);
+        return shards_[shard]->image(imageIndex - firstIndex_[shard], scratch);
+    }
+
+    int32_t label(size_t labelIndex) override {
+        size_t shard = locate(labelIndex);
+        return shards_[shard]->label(labelIndex - firstIndex_[shard]);
+    }
+
+    size_t numShards() const { return shards_.size(); }
+
+private:
+    std::vector<std::shared_ptr<IdxReader>> shards_;
+    std::vector<size_t> firstIndex_; // Global index of the first sample of every shard, then the total
+
+    size_t locate(size_t index) const {
+        return std::upper_bound(firstIndex_.begin(), firstIndex_.end(), index) - firstIndex_.begin() - 1;
+    }
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Types.hpp"
+#include <Eigen/Dense>
+
+// Interface through which NeuralNetwork pulls training batches, written straight into
+// the storage order of the network's layers
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
+class DataSource {
+public:
+    DataSource() = default;
+    virtual ~DataSource() = default;
+
+    // Fetch the next batch into caller-owned buffers: one sample per row of batchImages
+    // and its class index in batchLabels (pure virtual)
+    virtual void next(MatrixType<ComponentType, StorageOrder>& batchImages, LabelVector& batchLabels) = 0;
+
+    // Feedback of the per-sample losses of the batch served last (optional override)
+    virtual void reportLosses(const Eigen::Ref<const Eigen::VectorX<ComponentType>>& losses) {}
+
+    // Number of input features per sample, i.e. the column count of an image batch
+    virtual size_t sampleSize() const = 0;
+
+    // Number of classes the labels index into
+    virtual size_t numClasses() const = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "DataReaders.hpp"
+
+// Preprocessed dataset cache written by convert_mnist_cache. All values are little-endian
+// and every section starts on a 64-byte boundary:
+//   CacheHeader
+//   images: numSamples rows, each rowStride bytes apart (uint8 pixels or float32 in [0, 1])
+//   labels: numSamples int32 class indices
+
+const char cacheMagic[8] = {'N', 'N', 'C', 'A', 'C', 'H', 'E', '1'};
+const uint32_t cacheVersion = 1;
+const size_t cacheAlignment = 64;
+
+enum class CacheDType : uint32_t {
+    UInt8 = 0,
+    Float32 = 1
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t numSamples;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t numClasses;   // Given to the converter, so every split of a dataset agrees on it
+    uint32_t rowStride;    // Bytes between consecutive image rows
+    uint64_t imagesOffset; // Byte offset of the image section
+    uint64_t labelsOffset; // Byte offset of the label section
+};
+
+inline size_t alignToCache(size_t bytes) {
+    return (bytes + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+}
+
+// Reader that maps a cache file and serves rows in place, without any per-sample decode
+class CachedReader : public IdxReader {
+public:
+    CachedReader(const std::string& cacheFile, bool sequential)
+        : IdxReader(0, 0), file_(cacheFile, sizeof(CacheHeader), sequential) {
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, cacheMagic, sizeof(cacheMagic)) != 0) {
+            throw std::runtime_error("Invalid magic number in cache file: " + cacheFile);
+        }
+        if (header_.version != cacheVersion) {
+            throw std::runtime_error("Unsupported cache version " + std::to_string(header_.version) +
+                                     " in " + cacheFile);
+        }
+        if (header_.dtype != static_cast<uint32_t>(CacheDType::UInt8) &&
+            header_.dtype != static_cast<uint32_t>(CacheDType::Float32)) {
+            throw std::runtime_error("Unknown data type in cache file: " + cacheFile);
+        }
+        // Every row must hold a whole image, and the sections must fit in the file without
+        // their sizes wrapping around
+        size_t elementSize = isNormalized() ? sizeof(float) : sizeof(uint8_t);
+        imageSize_ = static_cast<size_t>(header_.rows) * header_.cols;
+        if (header_.rowStride < imageSize_ * elementSize) {
+            throw std::runtime_error("Row stride is smaller than an image in cache file: " + cacheFile);
+        }
+        if (header_.imagesOffset > file_.size() || header_.labelsOffset > file_.size() ||
+            (header_.rowStride > 0 && header_.numSamples > (file_.size() - header_.imagesOffset) / header_.rowStride) ||
+            header_.numSamples > (file_.size() - header_.labelsOffset) / sizeof(int32_t) ||
+            header_.labelsOffset < header_.imagesOffset + header_.numSamples * header_.rowStride) {
+            throw std::runtime_error("Cache file is smaller than its header declares: " + cacheFile);
+        }
+
+        numImages_ = header_.numSamples;
+        images_ = file_.data() + header_.imagesOffset;
+        labels_ = reinterpret_cast<const int32_t*>(file_.data() + header_.labelsOffset);
+    }
+
+    const uint8_t* image(size_t imageIndex, uint8_t* /*scratch*/) override {
+        return images_ + imageIndex * header_.rowStride;
+    }
+
+    int32_t label(size_t labelIndex) override {
+        return labels_[labelIndex];
+    }
+
+    bool isNormalized() const override {
+        return header_.dtype == static_cast<uint32_t>(CacheDType::Float32);
+    }
+
+    const float* normalizedImage(size_t imageIndex) override {
+        return reinterpret_cast<const float*>(images_ + imageIndex * header_.rowStride);
+    }
+
+    size_t rows() const { return header_.rows; }
+    size_t cols() const { return header_.cols; }
+    size_t numClasses() const { return header_.numClasses; }
+
+private:
+    MappedFile file_;
+    CacheHeader header_;
+    const uint8_t* images_ = nullptr;
+    const int32_t* labels_ = nullptr;
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Helper function to convert big-endian to little-endian, as IDX headers store their words
+inline uint32_t bigEndianToLittleEndian(uint32_t value) {
+    return ((value >> 24) & 0xff) |
+           ((value << 8) & 0xff0000) |
+           ((value >> 8) & 0xff00) |
+           ((value << 24) & 0xff000000);
+}
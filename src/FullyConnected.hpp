@@ -3,19 +3,37 @@
 #include "Base.hpp"
 #include "Initializers.hpp"
 #include "Optimizers.hpp"
+#include "Types.hpp"
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <Eigen/Dense>
 
-// Define MatrixType as an alias for Eigen::Matrix with dynamic rows and columns
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
-
-template<typename ComponentType>
-class FullyConnected : public BaseLayer<ComponentType> {
+// Activation applied in the epilogue of the layer's product, in place of a separate layer
+enum class FusedActivation {
+    None,
+    ReLU
+};
+
+inline FusedActivation parseFusedActivation(const std::string& name) {
+    if (name == "none") return FusedActivation::None;
+    if (name == "relu") return FusedActivation::ReLU;
+    throw std::invalid_argument("Unknown fused activation: " + name);
+}
+
+// Dense layer on batches with samples in rows, stored in the given order. Weights and
+// activations share that order, which decides how the three products of a step stride
+// through memory; bench_layout compares them.
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
+class FullyConnected : public BaseLayer<ComponentType, StorageOrder> {
 public:
-    FullyConnected(size_t input_size, size_t output_size)
-        : input_dim(input_size), output_dim(output_size),
-          weights(MatrixType<ComponentType>::Zero(input_size + 1, output_size)) {
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+
+    FullyConnected(size_t input_size, size_t output_size, FusedActivation activation = FusedActivation::None)
+        : input_dim(input_size), output_dim(output_size), activation(activation),
+          weights(Matrix::Zero(input_size, output_size)),
+          bias(Matrix::Zero(1, output_size)) {
         this->trainable = true;
     }
 
@@ -23,57 +41,157 @@ public:
 
     void initialize(const std::shared_ptr<Initializer<ComponentType>>& weights_initializer,
                     const std::shared_ptr<Initializer<ComponentType>>& bias_initializer) override {
-        // Initialize weights (all rows except the last)
-        weights.topRows(input_dim) = weights_initializer->initialize({input_dim, output_dim}, input_dim, output_dim);
+        weights = weights_initializer->initialize({input_dim, output_dim}, input_dim, output_dim);
+        bias = bias_initializer->initialize({1, output_dim}, input_dim, output_dim);
+    }
 
-        // Initialize bias (last row of weights)
-        weights.row(input_dim) = bias_initializer->initialize({1, output_dim}, input_dim, output_dim);
+    // The input is cached by reference: it must stay alive and unchanged until the matching
+    // backward(), which releases it. A forward() on an input that goes away first (such as a
+    // temporary, or an inference pass) must be followed by forget_input() or another forward().
+    Matrix forward(const Matrix& input_tensor) override {
+        this->input_tensor = &input_tensor;
+
+        // Bias is broadcast over the rows of the product
+        Matrix output(input_tensor.rows(), output_dim);
+        if (activation == FusedActivation::None) {
+            output.noalias() = input_tensor * weights;
+            output.rowwise() += bias.row(0);
+            return output;
+        }
+
+        // The product is computed one contiguous block of the output at a time (output columns
+        // when column-major, batch rows when row-major), and bias, activation and backward
+        // mask are applied to each block while it is still in cache
+        Eigen::Index rows = input_tensor.rows();
+        Eigen::Index cols = static_cast<Eigen::Index>(output_dim);
+        active.resize(rows, cols);
+        if constexpr (StorageOrder == Eigen::RowMajor) {
+            Eigen::Index tile = std::max<Eigen::Index>(1, epilogue_tile_elements / std::max<Eigen::Index>(1, cols));
+            for (Eigen::Index first = 0; first < rows; first += tile) {
+                Eigen::Index count = std::min(tile, rows - first);
+                auto block = output.middleRows(first, count);
+                block.noalias() = input_tensor.middleRows(first, count) * weights;
+                block.rowwise() += bias.row(0);
+                block = block.array().max(ComponentType(0));
+                active.middleRows(first, count) = block.array() > ComponentType(0);
+            }
+        } else {
+            Eigen::Index tile = std::max<Eigen::Index>(1, epilogue_tile_elements / std::max<Eigen::Index>(1, rows));
+            for (Eigen::Index first = 0; first < cols; first += tile) {
+                Eigen::Index count = std::min(tile, cols - first);
+                auto block = output.middleCols(first, count);
+                block.noalias() = input_tensor * weights.middleCols(first, count);
+                block.rowwise() += bias.middleCols(first, count).row(0);
+                block = block.array().max(ComponentType(0));
+                active.middleCols(first, count) = block.array() > ComponentType(0);
+            }
+        }
+        return output;
     }
 
-    MatrixType<ComponentType> forward(const MatrixType<ComponentType>& input_tensor) override {
-        // Add bias term
-        size_t batch_size = input_tensor.rows();
-        MatrixType<ComponentType> input_with_bias(batch_size, input_dim + 1);
-        input_with_bias << input_tensor, MatrixType<ComponentType>::Ones(batch_size, 1);
+    Matrix backward(const Matrix& error_tensor) override {
+        if (!input_tensor) {
+            throw std::logic_error("FullyConnected::backward() needs the input of a matching forward().");
+        }
 
-        this->input_tensor = input_with_bias;
+        // Gradient through the fused activation: the error only flows where the unit was active
+        const Matrix* error = &error_tensor;
+        if (activation == FusedActivation::ReLU) {
+            masked_error = active.select(error_tensor, ComponentType(0));
+            error = &masked_error;
+        }
 
-        // Perform matrix multiplication
-        return input_with_bias * weights;
+        // Accumulate gradients for weights, and for the bias by summing the error over the batch.
+        // The loss is a sum over samples, so the sum over micro-batches is the gradient of
+        // the whole accumulated batch.
+        if (has_gradients) {
+            grad_weights.noalias() += input_tensor->transpose() * *error;
+            grad_bias += error->colwise().sum();
+        } else {
+            grad_weights.noalias() = input_tensor->transpose() * *error;
+            grad_bias = error->colwise().sum();
+            has_gradients = true;
+        }
+        forget_input();
+
+        // Calculate gradient with respect to input, unless nothing upstream uses it
+        if (!input_gradient_needed) {
+            return Matrix();
+        }
+        return *error * weights.transpose();
     }
 
-    MatrixType<ComponentType> backward(const MatrixType<ComponentType>& error_tensor) override {
-        // Calculate gradients for weights
-        grad_weights = input_tensor.transpose() * error_tensor;
+    void apply_update() override {
+        // Update weights in place if optimizer is set and a backward pass contributed
+        // gradients. Parameters and gradients share a storage order, so their flat views
+        // line up element for element.
+        if (optimizer && has_gradients) {
+            optimizer->update_weights(flat(weights), flat(grad_weights));
+            bias_optimizer->update_weights(flat(bias), flat(grad_bias));
+        }
+        has_gradients = false;
+    }
 
-        // Update weights if optimizer is set
-        if (optimizer) {
-            weights = optimizer->update_weights(weights, grad_weights);
+    void select_rows(const std::vector<Eigen::Index>& rows) override {
+        if (!input_tensor) {
+            throw std::logic_error("FullyConnected::select_rows() needs the input of a matching forward().");
+        }
+        selected_input = (*input_tensor)(rows, Eigen::placeholders::all);
+        input_tensor = &selected_input;
+        if (activation == FusedActivation::ReLU) {
+            active = active(rows, Eigen::placeholders::all).eval();
         }
+    }
+
+    void forget_input() override {
+        input_tensor = nullptr;
+    }
 
-        // Calculate gradient with respect to input (excluding bias term)
-        return error_tensor * weights.topRows(input_dim).transpose();
+    void set_input_gradient_needed(bool needed) override {
+        input_gradient_needed = needed;
     }
 
     void set_optimizer(std::shared_ptr<Optimizer<ComponentType>> opt) override {
         optimizer = opt->clone(); // Make a deep copy
+        bias_optimizer = opt->clone(); // The bias keeps its own optimizer state
     }
 
-    const MatrixType<ComponentType>& get_grad_weights() const {
+    const Matrix& get_grad_weights() const {
         return grad_weights;
     }
 
+    const Matrix& get_grad_bias() const {
+        return grad_bias;
+    }
+
     // Whether the layer is trainable
     bool is_trainable() const override {
         return this->trainable;
     }
 
 private:
+    // Parameters as the flat vector the optimizers update, in storage order
+    static Eigen::Map<Eigen::VectorX<ComponentType>> flat(Matrix& parameters) {
+        return Eigen::Map<Eigen::VectorX<ComponentType>>(parameters.data(), parameters.size());
+    }
+
+    // Elements of the output block that the forward epilogue works on at a time
+    static constexpr Eigen::Index epilogue_tile_elements = 16384;
+
     size_t input_dim;
     size_t output_dim;
-    MatrixType<ComponentType> weights;
-    MatrixType<ComponentType> grad_weights;
-    MatrixType<ComponentType> input_tensor;
+    FusedActivation activation;
+    bool input_gradient_needed = true;
+    Matrix weights;
+    Matrix bias; // One row, broadcast over the batch
+    Matrix grad_weights;
+    Matrix grad_bias;
+    bool has_gradients = false; // Whether grad_weights and grad_bias hold gradients not yet applied
+    const Matrix* input_tensor = nullptr; // Input of the last forward(), until backward() or forget_input()
+    Matrix selected_input; // Rows kept by select_rows()
+    Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic, StorageOrder> active; // Units the fused activation let through
+    Matrix masked_error;
 
     std::unique_ptr<Optimizer<ComponentType>> optimizer = nullptr;
+    std::unique_ptr<Optimizer<ComponentType>> bias_optimizer = nullptr;
 };
\ No newline at end of file
@@ -1,14 +1,11 @@
 #pragma once
 
+#include "Types.hpp"
 #include <random>
 #include <cmath>
 #include <vector>
 #include <Eigen/Dense>
 
-// Define MatrixType as an alias for Eigen::Matrix with dynamic rows and columns
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
-
 template<typename ComponentType>
 class Initializer {
 public:
@@ -1,40 +1,86 @@
 #pragma once
 
+#include "Types.hpp"
 #include <Eigen/Dense>
+#include <cmath>
 #include <limits>
 
-// Define MatrixType as an alias for Eigen::Matrix with dynamic dimensions
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
-
-template<typename ComponentType>
+// Works on predictions and one-hot labels stored in the network's storage order
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
 class CrossEntropyLoss {
 public:
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+
     // Constructor
     CrossEntropyLoss() : epsilon(std::numeric_limits<ComponentType>::epsilon()) {}
     
     ~CrossEntropyLoss() = default;
 
-    ComponentType forward(const MatrixType<ComponentType>& prediction_tensor, 
-                          const MatrixType<ComponentType>& label_tensor) {
-        prediction_tensor_ = prediction_tensor;
-        label_tensor_ = label_tensor;
+    // The predictions are cached by reference, so they must stay alive and unchanged until
+    // backward()
+    ComponentType forward(const Matrix& prediction_tensor, 
+                          const Matrix& label_tensor) {
+        prediction_tensor_ = &prediction_tensor;
 
         // Compute cross-entropy loss
-        ComponentType loss = -(label_tensor_.array() * (prediction_tensor_.array() + epsilon).log()).sum();
+        sample_losses_ = -(label_tensor.array() * (prediction_tensor.array() + epsilon).log()).rowwise().sum();
+        ComponentType loss = sample_losses_.sum();
 
         return loss;
     }
 
-    MatrixType<ComponentType> backward(const MatrixType<ComponentType>& label_tensor) {
+    Matrix backward(const Matrix& label_tensor) {
         // Gradient of cross-entropy loss
-        MatrixType<ComponentType> error_tensor = -(label_tensor.array() / (prediction_tensor_.array() + epsilon));
+        Matrix error_tensor = -(label_tensor.array() / (prediction_tensor_->array() + epsilon));
 
         return error_tensor;
     }
 
+    // Class-index labels: only the predicted probability of each sample's own class
+    // enters the loss, so it is gathered instead of masked by a one-hot matrix
+    ComponentType forward(const Matrix& prediction_tensor, const LabelVector& labels) {
+        prediction_tensor_ = &prediction_tensor;
+
+        sample_losses_.resize(labels.size());
+        for (Eigen::Index i = 0; i < labels.size(); ++i) {
+            sample_losses_(i) = -std::log(prediction_tensor(i, labels(i)) + epsilon);
+        }
+        ComponentType loss = sample_losses_.sum();
+
+        return loss;
+    }
+
+    // The gradient is zero everywhere except at each sample's own class. It is written into
+    // a buffer kept between batches: only the entries set by the previous batch are cleared,
+    // so a step costs O(batch) once the buffer has the batch shape. The returned matrix is
+    // valid until the next call.
+    const Matrix& backward(const LabelVector& labels) {
+        const Matrix& prediction_tensor = *prediction_tensor_;
+        if (error_tensor_.rows() != prediction_tensor.rows() || error_tensor_.cols() != prediction_tensor.cols()) {
+            error_tensor_.setZero(prediction_tensor.rows(), prediction_tensor.cols());
+        } else {
+            for (Eigen::Index i = 0; i < error_labels_.size(); ++i) {
+                error_tensor_(i, error_labels_(i)) = 0;
+            }
+        }
+
+        for (Eigen::Index i = 0; i < labels.size(); ++i) {
+            error_tensor_(i, labels(i)) = -1 / (prediction_tensor(i, labels(i)) + epsilon);
+        }
+        error_labels_ = labels;
+
+        return error_tensor_;
+    }
+
+    // Loss of every sample of the last forward pass
+    const Eigen::VectorX<ComponentType>& sample_losses() const {
+        return sample_losses_;
+    }
+
 private:
-    MatrixType<ComponentType> prediction_tensor_;
-    MatrixType<ComponentType> label_tensor_;
+    const Matrix* prediction_tensor_ = nullptr; // Predictions of the last forward()
+    Eigen::VectorX<ComponentType> sample_losses_;
+    Matrix error_tensor_;       // Index-label gradient, zero outside error_labels_
+    LabelVector error_labels_;  // Class of every row set in error_tensor_
     const ComponentType epsilon; // Small constant for numerical stability
 };
\ No newline at end of file
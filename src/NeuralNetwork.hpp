@@ -4,6 +4,12 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
 #include "Base.hpp"
 #include "FullyConnected.hpp"
 #include "ReLU.hpp"
@@ -12,18 +18,39 @@
 #include "Loss.hpp"
 #include "Initializers.hpp"
 #include "Data.hpp"
+#include "Types.hpp"
 
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
+// Selective backprop: only the samples with the largest losses go through backward()
+struct SelectiveBackprop {
+    enum class Mode {
+        Off,
+        TopK,     // Keep the keep_fraction of the batch with the largest losses
+        Threshold // Keep the samples whose loss is at least loss_threshold
+    };
+    Mode mode = Mode::Off;
+    double keep_fraction = 0.5;
+    double loss_threshold = 0.0;
+};
 
-template<typename ComponentType>
+inline SelectiveBackprop::Mode parseSelectiveBackpropMode(const std::string& name) {
+    if (name == "off") return SelectiveBackprop::Mode::Off;
+    if (name == "topk") return SelectiveBackprop::Mode::TopK;
+    if (name == "threshold") return SelectiveBackprop::Mode::Threshold;
+    throw std::invalid_argument("Unknown selective backprop mode: " + name);
+}
+
+// Layers, data source, loss and optimizers all work on batches and parameters stored in
+// StorageOrder, so nothing is converted between them
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
 class NeuralNetwork {
 public:
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+
     NeuralNetwork(std::shared_ptr<Optimizer<ComponentType>> optimizer,
                   std::shared_ptr<Initializer<ComponentType>> weights_initializer,
                   std::shared_ptr<Initializer<ComponentType>> bias_initializer,
-                  DataLayer<ComponentType> data_layer,
-                  CrossEntropyLoss<ComponentType> loss_layer)
+                  std::shared_ptr<DataSource<ComponentType, StorageOrder>> data_layer,
+                  CrossEntropyLoss<ComponentType, StorageOrder> loss_layer)
         : optimizer_(optimizer),
           weights_initializer_(weights_initializer),
           bias_initializer_(bias_initializer),
@@ -34,62 +61,162 @@ public:
 
     ~NeuralNetwork() = default;
 
-    void append_layer(std::unique_ptr<BaseLayer<ComponentType>> layer) {
+    void append_layer(std::unique_ptr<BaseLayer<ComponentType, StorageOrder>> layer) {
         if (layer->is_trainable()) {
             layer->set_optimizer(optimizer_);
             layer->initialize(weights_initializer_, bias_initializer_);
+
+            // No layer before the first trainable one has parameters, so nothing needs
+            // the error with respect to its input
+            if (!first_trainable_layer_) {
+                first_trainable_layer_ = layers_.size();
+                layer->set_input_gradient_needed(false);
+            }
         }
         layers_.push_back(std::move(layer));
     }
 
+    void set_selective_backprop(const SelectiveBackprop& selective_backprop) {
+        if (selective_backprop.mode == SelectiveBackprop::Mode::TopK &&
+            !(selective_backprop.keep_fraction > 0.0 && selective_backprop.keep_fraction <= 1.0)) {
+            throw std::invalid_argument("Selective backprop must keep a fraction in (0, 1] of the batch.");
+        }
+        selective_backprop_ = selective_backprop;
+    }
+
+    // Number of micro-batches whose gradients are summed into every weight update
+    void set_accumulation_steps(size_t accumulation_steps) {
+        if (accumulation_steps == 0) {
+            throw std::invalid_argument("Gradient accumulation needs at least one step.");
+        }
+        accumulation_steps_ = accumulation_steps;
+    }
+
     ComponentType forward() {
-        // Fetch a batch of data
-        auto [input_tensor, label_tensor] = data_layer_.next();
-        current_label_tensor_ = label_tensor;
+        // Fetch a batch of data into the reusable input and label buffers
+        data_layer_->next(current_input_tensor_, current_label_tensor_);
 
-        // Forward pass through all layers
-        for (auto& layer : layers_) {
-            input_tensor = layer->forward(input_tensor);
+        // Forward pass through all layers. Layers may cache their input by reference, so
+        // every activation is kept until the backward pass.
+        activations_.resize(layers_.size());
+        for (size_t i = 0; i < layers_.size(); ++i) {
+            activations_[i] = layers_[i]->forward(i == 0 ? current_input_tensor_ : activations_[i - 1]);
         }
 
-        // Compute loss
-        ComponentType loss = loss_layer_.forward(input_tensor, label_tensor);
+        // Compute loss; the loss layer caches the predictions by reference
+        ComponentType loss = loss_layer_.forward(activations_.back(), current_label_tensor_);
+
+        // Let the data source weigh samples by how hard they are
+        data_layer_->reportLosses(loss_layer_.sample_losses());
         return loss;
     }
 
     void backward() {
-        // Compute initial error tensor from the loss layer
-        MatrixType<ComponentType> error_tensor = loss_layer_.backward(current_label_tensor_);
+        // Initial error from the loss layer, which keeps it in a buffer of its own. It is
+        // only copied once a layer or the row selection produces a new error.
+        Matrix error_tensor;
+        const Matrix* error = &loss_layer_.backward(current_label_tensor_);
 
-        // Backward pass through all layers in reverse order
-        for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
-            error_tensor = (*it)->backward(error_tensor);
+        // Compact the error and every layer's cached state to the selected samples, so the
+        // gradient GEMMs only see those rows
+        if (selective_backprop_.mode != SelectiveBackprop::Mode::Off) {
+            select_backprop_rows();
+            if (selected_rows_.empty()) {
+                return; // Every sample is below the threshold
+            }
+            if (static_cast<Eigen::Index>(selected_rows_.size()) < error->rows()) {
+                error_tensor = (*error)(selected_rows_, Eigen::placeholders::all).eval();
+                error = &error_tensor;
+                for (auto& layer : layers_) {
+                    layer->select_rows(selected_rows_);
+                }
+            }
+        }
+
+        // Backward pass through all layers in reverse order, down to the first trainable one
+        for (size_t i = layers_.size(); i-- > 0;) {
+            error_tensor = layers_[i]->backward(*error);
+            error = &error_tensor;
+            if (first_trainable_layer_ == i) {
+                break;
+            }
+        }
+    }
+
+    // Forward and backward pass over one batch, adding its gradients to every layer's
+    // accumulated gradients; returns the batch loss
+    ComponentType accumulate_gradients() {
+        ComponentType loss = forward();
+        backward();
+        return loss;
+    }
+
+    // Update every layer's parameters with the gradients accumulated so far
+    void apply_update() {
+        for (auto& layer : layers_) {
+            layer->apply_update();
         }
     }
 
+    // Every iteration is one weight update over accumulation_steps batches
     void train(size_t iterations) {
         for (size_t i = 0; i < iterations; ++i) {
-            ComponentType prediction = forward();
+            ComponentType prediction = 0;
+            for (size_t step = 0; step < accumulation_steps_; ++step) {
+                prediction += accumulate_gradients();
+            }
+            apply_update();
             loss_.push_back(prediction);
-            backward();
             std::cout << "Iteration: " << i << "    Loss = " << prediction << std::endl;
         }
     }
 
-    MatrixType<ComponentType> test(MatrixType<ComponentType> input_tensor) {
+    // Inference pass; no backward() follows, so the layers drop their references to the
+    // intermediate results, which do not outlive this call
+    Matrix test(Matrix input_tensor) {
         for (auto& layer : layers_) {
             input_tensor = layer->forward(input_tensor);
+            layer->forget_input();
         }
         return input_tensor;
     }
 
 private:
+    // Batch rows that take part in the backward pass, in ascending order
+    void select_backprop_rows() {
+        const auto& losses = loss_layer_.sample_losses();
+        selected_rows_.clear();
+        if (selective_backprop_.mode == SelectiveBackprop::Mode::Threshold) {
+            for (Eigen::Index i = 0; i < losses.size(); ++i) {
+                if (losses(i) >= selective_backprop_.loss_threshold) {
+                    selected_rows_.push_back(i);
+                }
+            }
+            return;
+        }
+
+        selected_rows_.resize(losses.size());
+        std::iota(selected_rows_.begin(), selected_rows_.end(), 0);
+        size_t keep = static_cast<size_t>(std::ceil(selective_backprop_.keep_fraction * losses.size()));
+        keep = std::clamp<size_t>(keep, 1, selected_rows_.size());
+        std::nth_element(selected_rows_.begin(), selected_rows_.begin() + keep - 1, selected_rows_.end(),
+                         [&losses](Eigen::Index a, Eigen::Index b) { return losses(a) > losses(b); });
+        selected_rows_.resize(keep);
+        std::sort(selected_rows_.begin(), selected_rows_.end());
+    }
+
     std::shared_ptr<Optimizer<ComponentType>> optimizer_;
     std::shared_ptr<Initializer<ComponentType>> weights_initializer_;
     std::shared_ptr<Initializer<ComponentType>> bias_initializer_;
     std::vector<ComponentType> loss_;
-    std::vector<std::unique_ptr<BaseLayer<ComponentType>>> layers_;
-    DataLayer<ComponentType> data_layer_;
-    CrossEntropyLoss<ComponentType> loss_layer_;
-    MatrixType<ComponentType> current_label_tensor_;
+    std::vector<std::unique_ptr<BaseLayer<ComponentType, StorageOrder>>> layers_;
+    std::shared_ptr<DataSource<ComponentType, StorageOrder>> data_layer_;
+    CrossEntropyLoss<ComponentType, StorageOrder> loss_layer_;
+    Matrix current_input_tensor_;
+    LabelVector current_label_tensor_; // Class index of every sample in the batch
+    std::vector<Matrix> activations_; // Output of every layer in the last forward pass
+    SelectiveBackprop selective_backprop_;
+    std::vector<Eigen::Index> selected_rows_;
+    size_t accumulation_steps_ = 1;
+    std::optional<size_t> first_trainable_layer_;
 };
\ No newline at end of file
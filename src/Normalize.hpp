@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Gather a batch of uint8 (or float32) samples, widen them and scale them into a
+// column-major destination: sample i, pixel j is written to dst[i + j * ld]. Full tiles
+// of samples are widened in SIMD registers and transposed there, so every store is a
+// contiguous run down one column; leftover rows and columns go through the scalar loop.
+
+namespace normalize_detail {
+
+template<typename T, typename Source>
+void scalarTile(const Source* const* samples, size_t rowBegin, size_t rowEnd,
+                size_t colBegin, size_t colEnd, T* dst, size_t ld, T scale) {
+    for (size_t j = colBegin; j < colEnd; ++j) {
+        T* column = dst + j * ld;
+        for (size_t i = rowBegin; i < rowEnd; ++i) {
+            column[i] = static_cast<T>(samples[i][j]) * scale;
+        }
+    }
+}
+
+inline int32_t loadBytes4(const uint8_t* p) {
+    int32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+#if defined(__AVX2__)
+
+inline void transpose8x8(__m256 r[8]) {
+    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+    __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+    __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+    __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+    __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+inline void transpose4x4(__m256d r[4]) {
+    __m256d t0 = _mm256_unpacklo_pd(r[0], r[1]);
+    __m256d t1 = _mm256_unpackhi_pd(r[0], r[1]);
+    __m256d t2 = _mm256_unpacklo_pd(r[2], r[3]);
+    __m256d t3 = _mm256_unpackhi_pd(r[2], r[3]);
+    r[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+    r[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+    r[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+    r[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+inline __m256 loadScaled8(const uint8_t* p, __m256 scale) {
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), scale);
+}
+
+inline __m256 loadScaled8(const float* p, __m256 scale) {
+    return _mm256_mul_ps(_mm256_loadu_ps(p), scale);
+}
+
+inline __m256d loadScaled4(const uint8_t* p, __m256d scale) {
+    __m128i bytes = _mm_cvtsi32_si128(loadBytes4(p));
+    return _mm256_mul_pd(_mm256_cvtepi32_pd(_mm_cvtepu8_epi32(bytes)), scale);
+}
+
+inline __m256d loadScaled4(const float* p, __m256d scale) {
+    return _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(p)), scale);
+}
+
+// 8 samples x 8 pixels per tile
+template<typename Source>
+void normalizeTiles(const Source* const* samples, size_t count, size_t width,
+                    float* dst, size_t ld, float scale, size_t& rowsDone, size_t& colsDone) {
+    const __m256 vscale = _mm256_set1_ps(scale);
+    rowsDone = count - count % 8;
+    colsDone = width - width % 8;
+    for (size_t i = 0; i < rowsDone; i += 8) {
+        for (size_t j = 0; j < colsDone; j += 8) {
+            __m256 r[8];
+            for (int k = 0; k < 8; ++k) {
+                r[k] = loadScaled8(samples[i + k] + j, vscale);
+            }
+            transpose8x8(r);
+            for (int k = 0; k < 8; ++k) {
+                _mm256_storeu_ps(dst + i + (j + k) * ld, r[k]);
+            }
+        }
+    }
+}
+
+// 4 samples x 4 pixels per tile
+template<typename Source>
+void normalizeTiles(const Source* const* samples, size_t count, size_t width,
+                    double* dst, size_t ld, double scale, size_t& rowsDone, size_t& colsDone) {
+    const __m256d vscale = _mm256_set1_pd(scale);
+    rowsDone = count - count % 4;
+    colsDone = width - width % 4;
+    for (size_t i = 0; i < rowsDone; i += 4) {
+        for (size_t j = 0; j < colsDone; j += 4) {
+            __m256d r[4];
+            for (int k = 0; k < 4; ++k) {
+                r[k] = loadScaled4(samples[i + k] + j, vscale);
+            }
+            transpose4x4(r);
+            for (int k = 0; k < 4; ++k) {
+                _mm256_storeu_pd(dst + i + (j + k) * ld, r[k]);
+            }
+        }
+    }
+}
+
+#elif defined(__SSE2__)
+
+inline __m128 load4ps(const uint8_t* p) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i bytes = _mm_cvtsi32_si128(loadBytes4(p));
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+
+inline __m128 load4ps(const float* p) {
+    return _mm_loadu_ps(p);
+}
+
+// 4 samples x 4 pixels per tile
+template<typename Source>
+void normalizeTiles(const Source* const* samples, size_t count, size_t width,
+                    float* dst, size_t ld, float scale, size_t& rowsDone, size_t& colsDone) {
+    const __m128 vscale = _mm_set1_ps(scale);
+    rowsDone = count - count % 4;
+    colsDone = width - width % 4;
+    for (size_t i = 0; i < rowsDone; i += 4) {
+        for (size_t j = 0; j < colsDone; j += 4) {
+            __m128 r0 = _mm_mul_ps(load4ps(samples[i] + j), vscale);
+            __m128 r1 = _mm_mul_ps(load4ps(samples[i + 1] + j), vscale);
+            __m128 r2 = _mm_mul_ps(load4ps(samples[i + 2] + j), vscale);
+            __m128 r3 = _mm_mul_ps(load4ps(samples[i + 3] + j), vscale);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(dst + i + j * ld, r0);
+            _mm_storeu_ps(dst + i + (j + 1) * ld, r1);
+            _mm_storeu_ps(dst + i + (j + 2) * ld, r2);
+            _mm_storeu_ps(dst + i + (j + 3) * ld, r3);
+        }
+    }
+}
+
+// 2 samples x 4 pixels per tile
+template<typename Source>
+void normalizeTiles(const Source* const* samples, size_t count, size_t width,
+                    double* dst, size_t ld, double scale, size_t& rowsDone, size_t& colsDone) {
+    const __m128d vscale = _mm_set1_pd(scale);
+    rowsDone = count - count % 2;
+    colsDone = width - width % 4;
+    for (size_t i = 0; i < rowsDone; i += 2) {
+        for (size_t j = 0; j < colsDone; j += 4) {
+            __m128 a = load4ps(samples[i] + j);
+            __m128 b = load4ps(samples[i + 1] + j);
+            __m128d a01 = _mm_mul_pd(_mm_cvtps_pd(a), vscale);
+            __m128d a23 = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(a, a)), vscale);
+            __m128d b01 = _mm_mul_pd(_mm_cvtps_pd(b), vscale);
+            __m128d b23 = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(b, b)), vscale);
+            _mm_storeu_pd(dst + i + j * ld, _mm_unpacklo_pd(a01, b01));
+            _mm_storeu_pd(dst + i + (j + 1) * ld, _mm_unpackhi_pd(a01, b01));
+            _mm_storeu_pd(dst + i + (j + 2) * ld, _mm_unpacklo_pd(a23, b23));
+            _mm_storeu_pd(dst + i + (j + 3) * ld, _mm_unpackhi_pd(a23, b23));
+        }
+    }
+}
+
+#else
+
+template<typename T, typename Source>
+void normalizeTiles(const Source* const*, size_t, size_t, T*, size_t, T,
+                    size_t& rowsDone, size_t& colsDone) {
+    rowsDone = 0;
+    colsDone = 0;
+}
+
+#endif
+
+} // namespace normalize_detail
+
+template<typename T, typename Source>
+void normalizeBatch(const Source* const* samples, size_t count, size_t width, T* dst, size_t ld, T scale) {
+    size_t rowsDone = 0;
+    size_t colsDone = 0;
+    normalize_detail::normalizeTiles(samples, count, width, dst, ld, scale, rowsDone, colsDone);
+
+    // Columns to the right of the vectorized tiles, then rows below them
+    normalize_detail::scalarTile(samples, 0, rowsDone, colsDone, width, dst, ld, scale);
+    normalize_detail::scalarTile(samples, rowsDone, count, 0, width, dst, ld, scale);
+}
+
+// Same into a row-major destination: sample i, pixel j is written to dst[i * ld + j]. Every
+// sample is a contiguous run there, so no transpose is needed and the plain widening loop
+// vectorizes as it is.
+template<typename T, typename Source>
+void normalizeBatchRows(const Source* const* samples, size_t count, size_t width, T* dst, size_t ld, T scale) {
+    for (size_t i = 0; i < count; ++i) {
+        const Source* sample = samples[i];
+        T* row = dst + i * ld;
+        for (size_t j = 0; j < width; ++j) {
+            row[j] = static_cast<T>(sample[j]) * scale;
+        }
+    }
+}
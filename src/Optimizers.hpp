@@ -1,27 +1,30 @@
 #pragma once
 
+#include "Types.hpp"
 #include <memory>
 #include <limits>
 #include <Eigen/Dense>
 
-// Define MatrixType as an alias for Eigen::Matrix with dynamic rows and columns
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
-
+// Parameters reach the optimizers as flat vectors and are updated in place. Every update
+// is elementwise, so neither the shape nor the storage order of the parameters matters,
+// and no layout has to be converted.
 template<typename ComponentType>
 class Optimizer {
 public:
+    using Vector = Eigen::VectorX<ComponentType>;
+
     Optimizer() = default;
     virtual ~Optimizer() = default;
     virtual std::unique_ptr<Optimizer<ComponentType>> clone() const = 0;
-    virtual MatrixType<ComponentType> update_weights(
-        const MatrixType<ComponentType>& weight_tensor,
-        const MatrixType<ComponentType>& gradient_tensor) = 0;
+    virtual void update_weights(Eigen::Ref<Vector> weight_tensor,
+                                const Eigen::Ref<const Vector>& gradient_tensor) = 0;
 };
 
 template<typename ComponentType>
 class Sgd : public Optimizer<ComponentType> {
 public:
+    using Vector = typename Optimizer<ComponentType>::Vector;
+
     // Constructor to initialize the learning rate.
     explicit Sgd(ComponentType learning_rate = ComponentType(0.001)) : learning_rate_(learning_rate) {}
     ~Sgd() = default;
@@ -30,18 +33,16 @@ public:
         return std::make_unique<Sgd<ComponentType>>(*this);
     }
 
-    // Function to calculate and return the updated weights.
-    MatrixType<ComponentType> update_weights(
-        const MatrixType<ComponentType>& weight_tensor,
-        const MatrixType<ComponentType>& gradient_tensor) override {
+    // Function to update the weights in place.
+    void update_weights(Eigen::Ref<Vector> weight_tensor,
+                        const Eigen::Ref<const Vector>& gradient_tensor) override {
         // Ensure weight_tensor and gradient_tensor have the same shape.
-        if (weight_tensor.rows() != gradient_tensor.rows() ||
-            weight_tensor.cols() != gradient_tensor.cols()) {
+        if (weight_tensor.size() != gradient_tensor.size()) {
             throw std::invalid_argument("Weight tensor and gradient tensor must have the same shape.");
         }
 
         // Compute the updated weights directly using Eigen's operations.
-        return weight_tensor - learning_rate_ * gradient_tensor;
+        weight_tensor -= learning_rate_ * gradient_tensor;
     }
 
 private:
@@ -52,6 +53,8 @@ private:
 template<typename ComponentType>
 class SgdWithMomentum : public Optimizer<ComponentType> {
 public:
+    using Vector = typename Optimizer<ComponentType>::Vector;
+
     // Constructor to initialize the learning rate and momentum.
     explicit SgdWithMomentum(ComponentType learning_rate = ComponentType(0.001),
                              ComponentType momentum = ComponentType(0.9))
@@ -62,38 +65,38 @@ public:
         return std::make_unique<SgdWithMomentum<ComponentType>>(*this);
     }
 
-    // Function to calculate and return the updated weights with momentum.
-    MatrixType<ComponentType> update_weights(
-        const MatrixType<ComponentType>& weight_tensor,
-        const MatrixType<ComponentType>& gradient_tensor) override {
+    // Function to update the weights in place with momentum.
+    void update_weights(Eigen::Ref<Vector> weight_tensor,
+                        const Eigen::Ref<const Vector>& gradient_tensor) override {
         // Ensure weight_tensor and gradient_tensor have the same shape.
-        if (weight_tensor.rows() != gradient_tensor.rows() ||
-            weight_tensor.cols() != gradient_tensor.cols()) {
+        if (weight_tensor.size() != gradient_tensor.size()) {
             throw std::invalid_argument("Weight tensor and gradient tensor must have the same shape.");
         }
 
         // Initialize velocity on the first update if it's not already initialized.
         if (velocity.size() == 0) {
-            velocity = MatrixType<ComponentType>::Zero(weight_tensor.rows(), weight_tensor.cols());
+            velocity = Vector::Zero(weight_tensor.size());
         }
 
         // Update the velocity (momentum term)
         velocity = momentum_ * velocity - learning_rate_ * gradient_tensor;
 
         // Update weights with the calculated velocity
-        return weight_tensor + velocity;
+        weight_tensor += velocity;
     }
 
 private:
     ComponentType learning_rate_;
     ComponentType momentum_;
-    MatrixType<ComponentType> velocity;  // Stores the momentum term (velocity)
+    Vector velocity;  // Stores the momentum term (velocity)
 };
 
 
 template<typename ComponentType>
 class Adam : public Optimizer<ComponentType> {
 public:
+    using Vector = typename Optimizer<ComponentType>::Vector;
+
     explicit Adam(ComponentType learning_rate = ComponentType(0.001),
                   ComponentType mu = ComponentType(0.9),
                   ComponentType rho = ComponentType(0.999))
@@ -107,20 +110,18 @@ public:
         return std::make_unique<Adam<ComponentType>>(*this);
     }
 
-    MatrixType<ComponentType> update_weights(
-        const MatrixType<ComponentType>& weight_tensor,
-        const MatrixType<ComponentType>& gradient_tensor) override {
+    void update_weights(Eigen::Ref<Vector> weight_tensor,
+                        const Eigen::Ref<const Vector>& gradient_tensor) override {
 
-        if (weight_tensor.rows() != gradient_tensor.rows() ||
-            weight_tensor.cols() != gradient_tensor.cols()) {
+        if (weight_tensor.size() != gradient_tensor.size()) {
             throw std::invalid_argument("Weight tensor and gradient tensor must have the same shape.");
         }
 
         if (v_.size() == 0) {
-            v_ = MatrixType<ComponentType>::Zero(weight_tensor.rows(), weight_tensor.cols());
+            v_ = Vector::Zero(weight_tensor.size());
         }
         if (r_.size() == 0) {
-            r_ = MatrixType<ComponentType>::Zero(weight_tensor.rows(), weight_tensor.cols());
+            r_ = Vector::Zero(weight_tensor.size());
         }
 
         t_++; // Increment time step
@@ -130,15 +131,12 @@ public:
         r_ = rho_ * r_ + (1 - rho_) * gradient_tensor.array().square().matrix();
 
         // Bias correction
-        MatrixType<ComponentType> v_hat = v_ / (1 - std::pow(mu_, t_));
-        MatrixType<ComponentType> r_hat = r_ / (1 - std::pow(rho_, t_));
-
-        // Compute updated weights
-        MatrixType<ComponentType> updated_weights = weight_tensor - 
-            (learning_rate_ * v_hat.array() / (r_hat.array().sqrt() + epsilon_).array()).matrix();
-
+        auto v_correction = static_cast<ComponentType>(1 - std::pow(mu_, t_));
+        auto r_correction = static_cast<ComponentType>(1 - std::pow(rho_, t_));
 
-        return updated_weights;
+        // Update the weights with the bias-corrected moments in a single pass
+        weight_tensor.array() -= learning_rate_ * (v_.array() / v_correction) /
+                                 ((r_.array() / r_correction).sqrt() + epsilon_);
     }
 
 private:
@@ -147,6 +145,6 @@ private:
     ComponentType rho_;
     ComponentType epsilon_;
     size_t t_;
-    MatrixType<ComponentType> v_;  // First moment vector (v)
-    MatrixType<ComponentType> r_;  // Second moment vector (r)
+    Vector v_;  // First moment vector (v)
+    Vector r_;  // Second moment vector (r)
 };
\ No newline at end of file
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+// Building blocks for coroutine input pipelines. Every stage is a Generator that pulls
+// items from the stage before it, so stages compose like function calls:
+//   threadStage(batch(threadStage(mapStage(order(), read, threads, chunk), items)), depth)
+// mapStage only parallelizes within a chunk; work of different stages overlaps where a
+// threadStage puts the stages before it on a thread of their own.
+
+// Minimal single-pass generator in the style of C++23 std::generator, which libstdc++ 12
+// does not ship. The yielded object stays alive until the consumer advances, so it can be
+// moved out of *it.
+template<typename T>
+class Generator {
+public:
+    struct promise_type {
+        T* value = nullptr;
+        std::exception_ptr error;
+
+        Generator get_return_object() { return Generator(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T& item) noexcept {
+            value = std::addressof(item);
+            return {};
+        }
+        std::suspend_always yield_value(T&& item) noexcept {
+            value = std::addressof(item);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    class iterator {
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(Handle handle) : handle_(handle) {}
+
+        T& operator*() const { return *handle_.promise().value; }
+
+        iterator& operator++() {
+            advance(handle_);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return !handle_ || handle_.done(); }
+
+    private:
+        Handle handle_;
+    };
+
+    Generator() = default;
+    explicit Generator(Handle handle) : handle_(handle) {}
+    Generator(Generator&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Generator& operator=(Generator&& other) noexcept {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+    ~Generator() { reset(); }
+
+    // Runs the coroutine up to its first item; call once
+    iterator begin() {
+        if (handle_) {
+            advance(handle_);
+        }
+        return iterator(handle_);
+    }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    Handle handle_;
+
+    static void advance(Handle handle) {
+        handle.resume();
+        if (handle.done() && handle.promise().error) {
+            std::rethrow_exception(std::exchange(handle.promise().error, nullptr));
+        }
+    }
+
+    void reset() {
+        if (handle_) {
+            handle_.destroy();
+            handle_ = {};
+        }
+    }
+};
+
+// Fixed-capacity FIFO between a producer thread and a consumer. push() blocks while the
+// queue is full, which is what throttles a producer that runs ahead.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+    // Returns false if the consumer went away and the item was dropped
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return items_.size() < capacity_ || cancelled_; });
+        if (cancelled_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Next item, or nothing once the producer has finished. Rethrows a producer failure.
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return !items_.empty() || closed_; });
+        if (items_.empty()) {
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            return std::nullopt;
+        }
+        std::optional<T> item(std::move(items_.front()));
+        items_.pop_front();
+        notFull_.notify_one();
+        return item;
+    }
+
+    // Producer side: no more items, optionally because of an error
+    void close(std::exception_ptr error = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        error_ = error;
+        notEmpty_.notify_all();
+    }
+
+    // Consumer side: stop accepting items and release a blocked producer
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled_ = true;
+        notFull_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    bool cancelled_ = false;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+};
+
+template<typename T>
+class BufferPool;
+
+// Buffer lent by a BufferPool; it goes back to the pool when destroyed
+template<typename T>
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    PooledBuffer(std::shared_ptr<BufferPool<T>> pool, std::vector<T> data)
+        : pool_(std::move(pool)), data_(std::move(data)) {}
+    PooledBuffer(PooledBuffer&& other) noexcept = default;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            pool_ = std::move(other.pool_);
+            data_ = std::move(other.data_);
+        }
+        return *this;
+    }
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    ~PooledBuffer() { release(); }
+
+    T* data() { return data_.data(); }
+
+private:
+    std::shared_ptr<BufferPool<T>> pool_;
+    std::vector<T> data_;
+
+    void release();
+};
+
+// Free list of equally sized buffers. A pipeline keeps a bounded number of items in
+// flight, so once the pool has grown to that number it stops allocating. Buffers keep the
+// pool alive, so it may be dropped while they are still out.
+template<typename T>
+class BufferPool : public std::enable_shared_from_this<BufferPool<T>> {
+public:
+    explicit BufferPool(size_t size) : size_(size) {}
+
+    PooledBuffer<T> acquire() {
+        std::vector<T> data;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                data = std::move(free_.back());
+                free_.pop_back();
+            }
+        }
+        data.resize(size_);
+        return PooledBuffer<T>(this->shared_from_this(), std::move(data));
+    }
+
+    void release(std::vector<T> data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(std::move(data));
+    }
+
+private:
+    size_t size_;
+    std::vector<std::vector<T>> free_;
+    std::mutex mutex_;
+};
+
+template<typename T>
+void PooledBuffer<T>::release() {
+    if (pool_) {
+        pool_->release(std::move(data_));
+        pool_.reset();
+    }
+}
+
+namespace pipeline_detail {
+
+// Cancels the queue and joins the producer when the consuming coroutine is finished or
+// destroyed early
+template<typename T>
+struct ProducerGuard {
+    BoundedQueue<T>& queue;
+    std::thread& producer;
+    ~ProducerGuard() {
+        queue.cancel();
+        if (producer.joinable()) {
+            producer.join();
+        }
+    }
+};
+
+// Apply fn to every input on the OpenMP worker pool; kept out of the coroutine body so
+// the parallel region is outlined from an ordinary function
+template<typename In, typename Out, typename Fn>
+void parallelApply(std::vector<In>& inputs, std::vector<Out>& outputs, Fn& fn, size_t threads) {
+    std::exception_ptr error;
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(threads) if (threads > 1)
+    for (long i = 0; i < static_cast<long>(inputs.size()); ++i) {
+        try {
+            outputs[i] = fn(std::move(inputs[i]));
+        } catch (...) {
+            #pragma omp critical
+            error = std::current_exception();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace pipeline_detail
+
+// Run upstream on its own thread, at most capacity items ahead of the consumer
+template<typename T>
+Generator<T> threadStage(Generator<T> upstream, size_t capacity) {
+    BoundedQueue<T> queue(capacity);
+    std::thread producer([&queue, &upstream] {
+        try {
+            for (auto it = upstream.begin(); it != upstream.end(); ++it) {
+                if (!queue.push(std::move(*it))) {
+                    return;
+                }
+            }
+            queue.close();
+        } catch (...) {
+            queue.close(std::current_exception());
+        }
+    });
+    pipeline_detail::ProducerGuard<T> guard{queue, producer};
+
+    while (std::optional<T> item = queue.pop()) {
+        co_yield std::move(*item);
+    }
+}
+
+// Transform every item with fn, chunk items at a time spread over `threads` workers.
+// Items come out in their input order, and no more than one chunk is in flight.
+template<typename In, typename Fn, typename Out = std::invoke_result_t<Fn&, In&&>>
+Generator<Out> mapStage(Generator<In> upstream, Fn fn, size_t threads, size_t chunk) {
+    std::vector<In> inputs;
+    std::vector<Out> outputs;
+    auto it = upstream.begin();
+    while (it != upstream.end()) {
+        inputs.clear();
+        for (; it != upstream.end() && inputs.size() < chunk; ++it) {
+            inputs.push_back(std::move(*it));
+        }
+        outputs.resize(inputs.size());
+        pipeline_detail::parallelApply(inputs, outputs, fn, threads);
+
+        for (Out& output : outputs) {
+            co_yield std::move(output);
+        }
+    }
+}
@@ -1,21 +1,20 @@
 #pragma once
 
 #include "Base.hpp"
+#include "Types.hpp"
 #include <Eigen/Dense>
 
-// Define MatrixType as an alias for Eigen::Matrix with dynamic rows and columns
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
-
-template<typename ComponentType>
-class ReLU : public BaseLayer<ComponentType> {
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
+class ReLU : public BaseLayer<ComponentType, StorageOrder> {
 public:
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+
     // Constructor
     ReLU() { this->trainable = false; }
     ~ReLU() = default;
 
     // Forward pass
-    MatrixType<ComponentType> forward(const MatrixType<ComponentType>& input_tensor) override {
+    Matrix forward(const Matrix& input_tensor) override {
         // Store the input tensor for use in the backward pass
         input_tensor_ = input_tensor;
         // Apply ReLU activation (max(0, x)) element-wise using Eigen's array operations
@@ -23,19 +22,23 @@ public:
     }
 
     // Backward pass
-    MatrixType<ComponentType> backward(const MatrixType<ComponentType>& error_tensor) override {
+    Matrix backward(const Matrix& error_tensor) override {
         // Compute the ReLU gradient: 1 if input > 0, else 0
-        MatrixType<ComponentType> relu_gradient = (input_tensor_.array() > ComponentType(0)).template cast<ComponentType>();
+        Matrix relu_gradient = (input_tensor_.array() > ComponentType(0)).template cast<ComponentType>();
 
         // Multiply the error tensor by the gradient element-wise
         return error_tensor.array() * relu_gradient.array();
     }
 
+    void select_rows(const std::vector<Eigen::Index>& rows) override {
+        input_tensor_ = input_tensor_(rows, Eigen::placeholders::all).eval();
+    }
+
     // Whether the layer is trainable
     bool is_trainable() const {
         return this->trainable;
     }
 
 private:
-    MatrixType<ComponentType> input_tensor_; // Stores the input tensor for the backward pass
+    Matrix input_tensor_; // Stores the input tensor for the backward pass
 };
\ No newline at end of file
@@ -2,41 +2,45 @@
 
 #include <Eigen/Dense>
 #include "Base.hpp"
+#include "Types.hpp"
 
-template<typename ComponentType>
-using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic>;
-
-template<typename ComponentType>
-class SoftMax : public BaseLayer<ComponentType> {
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
+class SoftMax : public BaseLayer<ComponentType, StorageOrder> {
 public:
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+
     // Constructor
     SoftMax() { this->trainable = false; }
     ~SoftMax() = default;
 
     // Forward pass
-    MatrixType<ComponentType> forward(const MatrixType<ComponentType>& input_tensor) override {
-        MatrixType<ComponentType> exp_values = (input_tensor.colwise() - input_tensor.rowwise().maxCoeff()).array().exp();
+    Matrix forward(const Matrix& input_tensor) override {
+        Matrix exp_values = (input_tensor.colwise() - input_tensor.rowwise().maxCoeff()).array().exp();
         softmax_output_ = exp_values.array().colwise() / exp_values.rowwise().sum().array();
 
         return softmax_output_;
     }
 
     // Backward pass
-    MatrixType<ComponentType> backward(const MatrixType<ComponentType> & error_tensor) override {
+    Matrix backward(const Matrix & error_tensor) override {
         // Compute the weighted sum of errors row-wise
-        MatrixType<ComponentType> weighted_error_sum = (error_tensor.array() * softmax_output_.array()).rowwise().sum();
+        Matrix weighted_error_sum = (error_tensor.array() * softmax_output_.array()).rowwise().sum();
 
         // Compute the gradient of the input
-        MatrixType<ComponentType> grad_input = softmax_output_.array() * (error_tensor.array() - weighted_error_sum.replicate(1, error_tensor.cols()).array());
+        Matrix grad_input = softmax_output_.array() * (error_tensor.array() - weighted_error_sum.replicate(1, error_tensor.cols()).array());
 
         return grad_input;
     }
 
+    void select_rows(const std::vector<Eigen::Index>& rows) override {
+        softmax_output_ = softmax_output_(rows, Eigen::placeholders::all).eval();
+    }
+
     // Whether the layer is trainable
     bool is_trainable() const override {
         return this->trainable;
     }
 
 private:
-    MatrixType<ComponentType> softmax_output_; // Stores the output for use in backward pass
+    Matrix softmax_output_; // Stores the output for use in backward pass
 };
\ No newline at end of file
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "DataReaders.hpp"
+
+// Readers for tabular feature data. Both serve every sample as one contiguous row of
+// float features through normalizedImage(), with the feature count taken from the file
+// rather than assumed to be MNIST's 784.
+
+// CSV with one sample per line: the class index followed by the features, e.g.
+//   label,f0,f1,...
+//   3,0.25,1e-3,...
+// A first line whose leading field is not a number is treated as a header and skipped.
+// The file is mapped and parsed with std::from_chars in parallel over line-aligned
+// chunks, each thread writing its rows straight into the final feature storage.
+class CsvReader : public IdxReader {
+public:
+    // Labels must lie below numClasses, which is given rather than read off the labels so
+    // that every split of a dataset agrees on it
+    CsvReader(const std::string& csvFile, size_t numClasses, int threads = 0)
+        : IdxReader(0, 0), file_(csvFile, 0, true), numClasses_(numClasses) {
+        const char* begin = reinterpret_cast<const char*>(file_.data());
+        const char* end = begin + file_.size();
+        begin = skipHeader(begin, end);
+        if (begin == end) {
+            throw std::runtime_error("CSV file has no samples: " + csvFile);
+        }
+
+        // The feature count is fixed by the first sample
+        const char* firstLineEnd = std::find(begin, end, '\n');
+        imageSize_ = std::count(begin, firstLineEnd, ',');
+        if (imageSize_ == 0) {
+            throw std::runtime_error("CSV file has no feature columns: " + csvFile);
+        }
+
+        // Split the file into line-aligned chunks, one per thread
+        int numChunks = threads > 0 ? threads : omp_get_max_threads();
+        std::vector<const char*> bounds(numChunks + 1, end);
+        bounds[0] = begin;
+        for (int c = 1; c < numChunks; ++c) {
+            const char* split = std::max(bounds[c - 1], begin + (end - begin) * c / numChunks);
+            split = std::find(split, end, '\n');
+            bounds[c] = split == end ? end : split + 1;
+        }
+
+        // First pass counts the samples of every chunk so each knows its first row
+        std::vector<size_t> firstRow(numChunks + 1, 0);
+        #pragma omp parallel for schedule(static, 1) num_threads(numChunks)
+        for (int c = 0; c < numChunks; ++c) {
+            firstRow[c + 1] = countLines(bounds[c], bounds[c + 1]);
+        }
+        for (int c = 0; c < numChunks; ++c) {
+            firstRow[c + 1] += firstRow[c];
+        }
+        numImages_ = firstRow[numChunks];
+
+        features_.resize(numImages_ * imageSize_);
+        labels_.resize(numImages_);
+
+        // Second pass parses every chunk into its rows
+        std::exception_ptr error;
+        #pragma omp parallel for schedule(static, 1) num_threads(numChunks)
+        for (int c = 0; c < numChunks; ++c) {
+            try {
+                parseChunk(bounds[c], bounds[c + 1], firstRow[c]);
+            } catch (...) {
+                #pragma omp critical
+                error = std::current_exception();
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    const uint8_t* image(size_t /*imageIndex*/, uint8_t* /*scratch*/) override {
+        throw std::logic_error("CSV samples are only served as float features.");
+    }
+
+    int32_t label(size_t labelIndex) override {
+        return labels_[labelIndex];
+    }
+
+    bool isNormalized() const override { return true; }
+
+    const float* normalizedImage(size_t imageIndex) override {
+        return features_.data() + imageIndex * imageSize_;
+    }
+
+private:
+    MappedFile file_;
+    size_t numClasses_;
+    std::vector<float> features_; // numImages_ rows of imageSize_ features
+    std::vector<int32_t> labels_;
+
+    static bool isBlank(const char* first, const char* last) {
+        return std::all_of(first, last, [](char ch) { return ch == '\r' || ch == ' ' || ch == '\t'; });
+    }
+
+    static const char* skipHeader(const char* begin, const char* end) {
+        int32_t label;
+        if (std::from_chars(begin, end, label).ec == std::errc()) {
+            return begin;
+        }
+        const char* lineEnd = std::find(begin, end, '\n');
+        return lineEnd == end ? end : lineEnd + 1;
+    }
+
+    static size_t countLines(const char* first, const char* last) {
+        size_t count = 0;
+        while (first < last) {
+            const char* lineEnd = std::find(first, last, '\n');
+            count += !isBlank(first, lineEnd);
+            first = lineEnd + 1;
+        }
+        return count;
+    }
+
+    void parseChunk(const char* first, const char* last, size_t row) {
+        while (first < last) {
+            const char* lineEnd = std::find(first, last, '\n');
+            if (isBlank(first, lineEnd)) {
+                first = lineEnd + 1;
+                continue;
+            }
+
+            auto [labelEnd, labelError] = std::from_chars(first, lineEnd, labels_[row]);
+            if (labelError != std::errc() || labels_[row] < 0) {
+                throw std::runtime_error("Invalid class index in CSV row " + std::to_string(row));
+            }
+            if (static_cast<size_t>(labels_[row]) >= numClasses_) {
+                throw std::runtime_error("Class index " + std::to_string(labels_[row]) + " in CSV row " +
+                                         std::to_string(row) + " is out of range for " +
+                                         std::to_string(numClasses_) + " classes.");
+            }
+
+            const char* cursor = labelEnd;
+            float* out = features_.data() + row * imageSize_;
+            for (size_t j = 0; j < imageSize_; ++j) {
+                if (cursor == lineEnd || *cursor != ',') {
+                    throw std::runtime_error("CSV row " + std::to_string(row) + " has fewer than " +
+                                             std::to_string(imageSize_) + " features.");
+                }
+                auto [valueEnd, valueError] = std::from_chars(cursor + 1, lineEnd, out[j]);
+                if (valueError != std::errc()) {
+                    throw std::runtime_error("Invalid feature in CSV row " + std::to_string(row));
+                }
+                cursor = valueEnd;
+            }
+            if (!isBlank(cursor, lineEnd)) {
+                throw std::runtime_error("CSV row " + std::to_string(row) + " has more than " +
+                                         std::to_string(imageSize_) + " features.");
+            }
+
+            ++row;
+            first = lineEnd + 1;
+        }
+    }
+};
+
+// Raw little-endian float32 features, mapped and served in place:
+//   RawFloatHeader
+//   features: numSamples rows of numFeatures float32
+//   labels:   numSamples int32 class indices
+const char rawFloatMagic[4] = {'R', 'A', 'W', 'F'};
+
+struct RawFloatHeader {
+    char magic[4];
+    uint32_t numSamples;
+    uint32_t numFeatures;
+    uint32_t numClasses;
+};
+
+class RawFloatReader : public IdxReader {
+public:
+    RawFloatReader(const std::string& rawFile, bool sequential)
+        : IdxReader(0, 0), file_(rawFile, sizeof(RawFloatHeader), sequential) {
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, rawFloatMagic, sizeof(rawFloatMagic)) != 0) {
+            throw std::runtime_error("Invalid magic number in raw float file: " + rawFile);
+        }
+
+        numImages_ = header_.numSamples;
+        imageSize_ = header_.numFeatures;
+        size_t labelsOffset = sizeof(RawFloatHeader) + numImages_ * imageSize_ * sizeof(float);
+        if (file_.size() < labelsOffset + numImages_ * sizeof(int32_t)) {
+            throw std::runtime_error("Raw float file is smaller than its header declares: " + rawFile);
+        }
+        features_ = reinterpret_cast<const float*>(file_.data() + sizeof(RawFloatHeader));
+        labels_ = reinterpret_cast<const int32_t*>(file_.data() + labelsOffset);
+    }
+
+    const uint8_t* image(size_t /*imageIndex*/, uint8_t* /*scratch*/) override {
+        throw std::logic_error("Raw float samples are only served as float features.");
+    }
+
+    int32_t label(size_t labelIndex) override {
+        return labels_[labelIndex];
+    }
+
+    bool isNormalized() const override { return true; }
+
+    const float* normalizedImage(size_t imageIndex) override {
+        return features_ + imageIndex * imageSize_;
+    }
+
+    size_t numClasses() const { return header_.numClasses; }
+
+private:
+    MappedFile file_;
+    RawFloatHeader header_;
+    const float* features_ = nullptr;
+    const int32_t* labels_ = nullptr;
+};
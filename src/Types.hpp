@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <Eigen/Dense>
+
+// Define MatrixType as an alias for Eigen::Matrix with dynamic rows and columns. Batches
+// keep samples in rows; the storage order decides whether a sample's features are strided
+// (column-major) or contiguous (row-major).
+template<typename ComponentType, int StorageOrder = Eigen::ColMajor>
+using MatrixType = Eigen::Matrix<ComponentType, Eigen::Dynamic, Eigen::Dynamic, StorageOrder>;
+
+// Class index of every sample in a batch
+using LabelVector = Eigen::Matrix<int32_t, Eigen::Dynamic, 1>;
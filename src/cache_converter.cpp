@@ -0,0 +1,146 @@
+#include "DatasetCache.hpp"
+#include "Endian.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Read the header words of an IDX file, check its magic number and return the stream
+// positioned at the payload
+std::ifstream openIdxFile(const std::string& filename, uint32_t expectedMagic, std::vector<uint32_t>& dims) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+
+    uint32_t magicNumber;
+    file.read(reinterpret_cast<char*>(&magicNumber), sizeof(magicNumber));
+    magicNumber = bigEndianToLittleEndian(magicNumber);
+    if (magicNumber != expectedMagic) {
+        throw std::runtime_error("Invalid magic number: " + std::to_string(magicNumber));
+    }
+
+    for (auto& dim : dims) {
+        file.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+        dim = bigEndianToLittleEndian(dim);
+    }
+    return file;
+}
+
+void writePadding(std::ofstream& out, size_t bytes) {
+    static const char zeros[cacheAlignment] = {};
+    out.write(zeros, bytes);
+}
+
+void convert(const std::string& imageFile, const std::string& labelFile, const std::string& outputFile,
+             CacheDType dtype, size_t numClasses) {
+    std::vector<uint32_t> imageDims(3);
+    std::ifstream images = openIdxFile(imageFile, 2051, imageDims);
+    std::vector<uint32_t> labelDims(1);
+    std::ifstream labels = openIdxFile(labelFile, 2049, labelDims);
+
+    size_t numSamples = imageDims[0];
+    size_t imageSize = static_cast<size_t>(imageDims[1]) * imageDims[2];
+    if (labelDims[0] != numSamples) {
+        throw std::runtime_error("Mismatch between number of images and labels.");
+    }
+
+    std::vector<uint8_t> rawLabels(numSamples);
+    labels.read(reinterpret_cast<char*>(rawLabels.data()), numSamples);
+    if (static_cast<size_t>(labels.gcount()) != numSamples) {
+        throw std::runtime_error("Label file is smaller than its header declares.");
+    }
+
+    // The class count is given rather than read off the labels, so that the caches of
+    // every split agree on it
+    for (uint8_t label : rawLabels) {
+        if (label >= numClasses) {
+            throw std::runtime_error("Label " + std::to_string(label) + " is out of range for " +
+                                     std::to_string(numClasses) + " classes.");
+        }
+    }
+
+    size_t elementSize = dtype == CacheDType::Float32 ? sizeof(float) : sizeof(uint8_t);
+    size_t rowBytes = imageSize * elementSize;
+
+    CacheHeader header = {};
+    std::copy(std::begin(cacheMagic), std::end(cacheMagic), header.magic);
+    header.version = cacheVersion;
+    header.dtype = static_cast<uint32_t>(dtype);
+    header.numSamples = numSamples;
+    header.rows = imageDims[1];
+    header.cols = imageDims[2];
+    header.numClasses = static_cast<uint32_t>(numClasses);
+    header.rowStride = static_cast<uint32_t>(alignToCache(rowBytes));
+    header.imagesOffset = alignToCache(sizeof(CacheHeader));
+    header.labelsOffset = alignToCache(header.imagesOffset + numSamples * header.rowStride);
+
+    std::ofstream out(outputFile, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open file for writing: " + outputFile);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writePadding(out, header.imagesOffset - sizeof(header));
+
+    // Image rows, each padded out to the row stride
+    std::vector<uint8_t> pixels(imageSize);
+    std::vector<float> values(imageSize);
+    for (size_t i = 0; i < numSamples; ++i) {
+        images.read(reinterpret_cast<char*>(pixels.data()), imageSize);
+        if (static_cast<size_t>(images.gcount()) != imageSize) {
+            throw std::runtime_error("Image file is smaller than its header declares.");
+        }
+
+        if (dtype == CacheDType::Float32) {
+            std::transform(pixels.begin(), pixels.end(), values.begin(),
+                           [](uint8_t p) { return static_cast<float>(p) / 255.0f; });
+            out.write(reinterpret_cast<const char*>(values.data()), rowBytes);
+        } else {
+            out.write(reinterpret_cast<const char*>(pixels.data()), rowBytes);
+        }
+        writePadding(out, header.rowStride - rowBytes);
+    }
+    writePadding(out, header.labelsOffset - (header.imagesOffset + numSamples * header.rowStride));
+
+    // Labels as class indices
+    std::vector<int32_t> classIndices(rawLabels.begin(), rawLabels.end());
+    out.write(reinterpret_cast<const char*>(classIndices.data()), classIndices.size() * sizeof(int32_t));
+
+    if (!out) {
+        throw std::runtime_error("Failed to write cache file: " + outputFile);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4 || argc > 6) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <MNIST image file> <MNIST label file> <output file> [u8|f32] [num classes]" << std::endl;
+        return 1;
+    }
+
+    std::string imageFile = argv[1];
+    std::string labelFile = argv[2];
+    std::string outputFile = argv[3];
+    std::string dtypeName = argc >= 5 ? argv[4] : "f32";
+
+    try {
+        CacheDType dtype;
+        if (dtypeName == "u8") dtype = CacheDType::UInt8;
+        else if (dtypeName == "f32") dtype = CacheDType::Float32;
+        else throw std::invalid_argument("Unknown data type: " + dtypeName);
+
+        size_t numClasses = argc == 6 ? std::stoul(argv[5]) : 10;
+        if (numClasses == 0) {
+            throw std::invalid_argument("The class count must be positive.");
+        }
+
+        convert(imageFile, labelFile, outputFile, dtype, numClasses);
+        std::cout << "Cache saved to " << outputFile << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "Data.hpp"
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+struct BenchmarkCase {
+    std::string api; // "next" or "pipeline"
+    std::string type;
+    size_t batchSize;
+    bool shuffle;
+    bool cold;
+};
+
+struct BenchmarkResult {
+    size_t images = 0;
+    size_t sampleBytes = 0; // Bytes per sample in the source
+    double setupSeconds = 0.0;
+    double seconds = 0.0;
+};
+
+// Drop a file's clean pages from the page cache, so the next run reads it from disk
+void evictFromPageCache(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+// Touch every page of a file, so the next run finds it in the page cache
+void warmPageCache(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+    }
+}
+
+template<typename ComponentType>
+BenchmarkResult measure(const BenchmarkCase& c, const std::string& imageFile, const std::string& labelFile,
+                        DataLayerOptions options, size_t samples) {
+    BenchmarkResult result;
+    auto start = std::chrono::steady_clock::now();
+    DataLayer<ComponentType> layer(imageFile, labelFile, c.batchSize, c.shuffle, options);
+    auto loaded = std::chrono::steady_clock::now();
+    result.setupSeconds = std::chrono::duration<double>(loaded - start).count();
+    result.sampleBytes = layer.sourceSampleBytes();
+
+    ComponentType checksum = 0;
+    if (c.api == "next") {
+        MatrixType<ComponentType> images;
+        LabelVector labels;
+        while (result.images < samples) {
+            layer.next(images, labels);
+            checksum += images(0, 0);
+            result.images += images.rows();
+        }
+    } else {
+        while (result.images < samples) {
+            size_t epochStart = result.images;
+            for (auto& [images, labels] : layer.epochPipeline(options.readerThreads)) {
+                checksum += images(0, 0);
+                result.images += images.rows();
+                if (result.images >= samples) {
+                    break;
+                }
+            }
+            if (result.images == epochStart) {
+                throw std::runtime_error("The dataset holds fewer samples than one batch.");
+            }
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loaded).count();
+
+    if (checksum < 0) {
+        std::cerr << checksum << std::endl; // Keeps the work observable
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 6) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <image file> <label file> [data backend] [images per run] [reader threads]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string imageFile = argv[1];
+    std::string labelFile = argv[2];
+    std::string backendName = argc > 3 ? argv[3] : "stream";
+    size_t samples = argc > 4 ? std::stoul(argv[4]) : 20000;
+
+    try {
+        DataLayerOptions options;
+        options.backend = parseDataBackend(backendName);
+        options.readerThreads = argc > 5 ? std::stoul(argv[5]) : 1;
+        options.seed = 1;
+
+        std::vector<std::string> files = expandDatasetPaths(imageFile);
+        if (backendUsesLabelFile(options.backend)) {
+            std::vector<std::string> labelFiles = expandDatasetPaths(labelFile);
+            files.insert(files.end(), labelFiles.begin(), labelFiles.end());
+        }
+
+        // One run per combination, reported on stdout as JSON. The pipeline needs random
+        // access, so the streaming backend is only measured through next().
+        std::vector<BenchmarkCase> cases;
+        for (const char* api : {"next", "pipeline"}) {
+            if (options.backend == DataBackend::Streaming && std::string(api) == "pipeline") {
+                continue;
+            }
+            for (const char* type : {"float", "double"}) {
+                for (size_t batchSize : {32, 128, 512}) {
+                    for (bool shuffle : {false, true}) {
+                        for (bool cold : {false, true}) {
+                            cases.push_back({api, type, batchSize, shuffle, cold});
+                        }
+                    }
+                }
+            }
+        }
+
+        std::ostringstream json;
+        json << "{\n  \"backend\": \"" << backendName << "\",\n"
+             << "  \"reader_threads\": " << options.readerThreads << ",\n"
+             << "  \"runs\": [";
+        for (size_t k = 0; k < cases.size(); ++k) {
+            const BenchmarkCase& c = cases[k];
+            for (const std::string& file : files) {
+                if (c.cold) {
+                    evictFromPageCache(file);
+                } else {
+                    warmPageCache(file);
+                }
+            }
+
+            BenchmarkResult result = c.type == "float"
+                ? measure<float>(c, imageFile, labelFile, options, samples)
+                : measure<double>(c, imageFile, labelFile, options, samples);
+
+            // Bytes read from the source, not the size of the converted batches
+            double bytes = static_cast<double>(result.images) * result.sampleBytes;
+            std::cerr << c.api << " " << c.type << " batch " << c.batchSize << (c.shuffle ? " shuffled" : "")
+                      << (c.cold ? " cold" : " warm") << ": " << result.images / result.seconds << " images/s"
+                      << std::endl;
+
+            json << (k ? "," : "") << "\n    {\"api\": \"" << c.api << "\", \"type\": \"" << c.type
+                 << "\", \"batch_size\": " << c.batchSize
+                 << ", \"shuffle\": " << (c.shuffle ? "true" : "false")
+                 << ", \"page_cache\": \"" << (c.cold ? "cold" : "warm") << "\""
+                 << ", \"images\": " << result.images
+                 << ", \"setup_seconds\": " << result.setupSeconds
+                 << ", \"seconds\": " << result.seconds
+                 << ", \"images_per_second\": " << result.images / result.seconds
+                 << ", \"mb_per_second\": " << bytes / result.seconds / 1e6 << "}";
+        }
+        json << "\n  ]\n}\n";
+        std::cout << json.str();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "NeuralNetwork.hpp"
+#include "SyntheticData.hpp"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Times the three products of a dense layer step in both storage orders:
+//   forward      output      = input * weights
+//   weight-grad  grad_weight = input^T * error
+//   input-grad   grad_input  = error * weights^T
+// Column-major batches keep each feature contiguous across the batch; row-major batches
+// keep each sample's features contiguous, which is the memory of a feature-major
+// column-major matrix with batch in columns.
+// A whole training step then decides the layout: a network of input -> output -> classes
+// pulls a batch from its data source, runs forward, loss and backward, and applies the
+// optimizer update, all in the storage order being measured. Its winner is printed as the
+// storage_order setting for main.
+
+struct BenchmarkShape {
+    Eigen::Index batchSize;
+    Eigen::Index inputSize;
+    Eigen::Index outputSize;
+    size_t iterations;
+    size_t numClasses = 10;
+};
+
+// Milliseconds per call of fn, best of three rounds after one warm-up call
+template<typename Fn>
+double timeCall(Fn&& fn, size_t iterations) {
+    fn();
+    double best = std::numeric_limits<double>::max();
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            fn();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, elapsed * 1e3 / iterations);
+    }
+    return best;
+}
+
+// Forward, weight-grad and input-grad products, then a whole training step
+template<typename ComponentType, int StorageOrder>
+std::vector<double> measure(const BenchmarkShape& shape) {
+    using Matrix = MatrixType<ComponentType, StorageOrder>;
+    Matrix input = Matrix::Random(shape.batchSize, shape.inputSize);
+    Matrix weights = Matrix::Random(shape.inputSize, shape.outputSize);
+    Matrix error = Matrix::Random(shape.batchSize, shape.outputSize);
+    Matrix output(shape.batchSize, shape.outputSize);
+    Matrix gradWeights(shape.inputSize, shape.outputSize);
+    Matrix gradInput(shape.batchSize, shape.inputSize);
+
+    std::vector<double> times;
+    times.push_back(timeCall([&] { output.noalias() = input * weights; }, shape.iterations));
+    times.push_back(timeCall([&] { gradWeights.noalias() = input.transpose() * error; }, shape.iterations));
+    times.push_back(timeCall([&] { gradInput.noalias() = error * weights.transpose(); }, shape.iterations));
+
+    // NeuralNetwork reports on std::cout; keep that out of the table
+    std::ostringstream discarded;
+    std::streambuf* console = std::cout.rdbuf(discarded.rdbuf());
+    auto data = std::make_shared<SyntheticDataSource<ComponentType, StorageOrder>>(
+        shape.batchSize, shape.inputSize, shape.numClasses, 42);
+    auto initializer = std::make_shared<He<ComponentType>>(1);
+    NeuralNetwork<ComponentType, StorageOrder> nn(std::make_shared<Adam<ComponentType>>(), initializer, initializer,
+                                                  data, CrossEntropyLoss<ComponentType, StorageOrder>());
+    nn.append_layer(std::make_unique<FullyConnected<ComponentType, StorageOrder>>(
+        shape.inputSize, shape.outputSize, FusedActivation::ReLU));
+    nn.append_layer(std::make_unique<FullyConnected<ComponentType, StorageOrder>>(
+        shape.outputSize, shape.numClasses));
+    nn.append_layer(std::make_unique<SoftMax<ComponentType, StorageOrder>>());
+    times.push_back(timeCall([&] {
+        nn.accumulate_gradients();
+        nn.apply_update();
+    }, shape.iterations));
+    std::cout.rdbuf(console);
+
+    ComponentType checksum = output(0, 0) + gradWeights(0, 0) + gradInput(0, 0);
+    if (std::isnan(checksum)) {
+        std::cerr << checksum << std::endl; // Keeps the work observable
+    }
+    return times;
+}
+
+template<typename ComponentType>
+void run(const std::string& typeName, const BenchmarkShape& shape) {
+    const std::vector<std::string> products = {"forward", "weight-grad", "input-grad", "train step"};
+    std::vector<double> colMajor = measure<ComponentType, Eigen::ColMajor>(shape);
+    std::vector<double> rowMajor = measure<ComponentType, Eigen::RowMajor>(shape);
+
+    for (size_t k = 0; k < products.size(); ++k) {
+        std::cout << std::left << std::setw(8) << typeName << std::setw(13) << products[k]
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << colMajor[k] << std::setw(12) << rowMajor[k]
+                  << std::setw(12) << (colMajor[k] <= rowMajor[k] ? "col-major" : "row-major") << std::endl;
+    }
+    std::cout << std::left << std::setw(8) << typeName << "storage_order = "
+              << (colMajor.back() <= rowMajor.back() ? "col-major" : "row-major") << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 5) {
+        std::cerr << "Usage: " << argv[0] << " [batch size] [input size] [output size] [iterations]" << std::endl;
+        return 1;
+    }
+
+    BenchmarkShape shape;
+    shape.batchSize = argc > 1 ? std::stol(argv[1]) : 128;
+    shape.inputSize = argc > 2 ? std::stol(argv[2]) : 28 * 28;
+    shape.outputSize = argc > 3 ? std::stol(argv[3]) : 128;
+    shape.iterations = argc > 4 ? std::stoul(argv[4]) : 100;
+
+    std::cout << "Dense layer products, batch " << shape.batchSize << ", " << shape.inputSize << " -> "
+              << shape.outputSize << ", best of 3 x " << shape.iterations << " calls" << std::endl;
+    std::cout << std::left << std::setw(8) << "type" << std::setw(13) << "product" << std::right
+              << std::setw(12) << "col-major" << std::setw(12) << "row-major" << std::setw(12) << "fastest"
+              << "  (ms per call)" << std::endl;
+
+    run<float>("float", shape);
+    run<double>("double", shape);
+
+    return 0;
+}
@@ -18,6 +18,27 @@ struct Config {
     std::string testImagesPath;
     std::string testLabelsPath;
     std::string logFilePath;
+    std::string dataBackend = "stream";
+    size_t numClasses = 10;
+    size_t prefetchDepth = 0;
+    size_t shardId = 0;
+    size_t shardCount = 1;
+    unsigned dataSeed = 0;
+    std::string shuffleMode = "full";
+    size_t shuffleBlockSize = 256;
+    size_t shuffleWindowBlocks = 16;
+    size_t streamChunkSize = 4096;
+    size_t shuffleBufferSize = 16384;
+    size_t readerThreads = 1;
+    double importanceFloor = 0.05;
+    double importanceInitialScore = 1.0;
+    std::string selectiveBackprop = "off";
+    double backpropKeepFraction = 0.5;
+    double backpropLossThreshold = 0.0;
+    std::string fusedActivation = "none";
+    size_t accumulationSteps = 1;
+    std::string storageOrder = "col-major";
+    AugmentationOptions augmentation;
 
     void load(const std::string& configFile) {
         std::ifstream file(configFile);
@@ -43,11 +64,153 @@ struct Config {
                 else if (key == "rel_path_test_images") testImagesPath = value;
                 else if (key == "rel_path_test_labels") testLabelsPath = value;
                 else if (key == "rel_path_log_file") logFilePath = value;
+                else if (key == "data_backend") dataBackend = value;
+                else if (key == "num_classes") numClasses = std::stoi(value);
+                else if (key == "prefetch_depth") prefetchDepth = std::stoi(value);
+                else if (key == "shard_id") shardId = std::stoi(value);
+                else if (key == "shard_count") shardCount = std::stoi(value);
+                else if (key == "data_seed") dataSeed = std::stoul(value);
+                else if (key == "shuffle_mode") shuffleMode = value;
+                else if (key == "shuffle_block_size") shuffleBlockSize = std::stoi(value);
+                else if (key == "shuffle_window_blocks") shuffleWindowBlocks = std::stoi(value);
+                else if (key == "stream_chunk_size") streamChunkSize = std::stoi(value);
+                else if (key == "shuffle_buffer_size") shuffleBufferSize = std::stoi(value);
+                else if (key == "reader_threads") readerThreads = std::stoi(value);
+                else if (key == "importance_floor") importanceFloor = std::stod(value);
+                else if (key == "importance_initial_score") importanceInitialScore = std::stod(value);
+                else if (key == "selective_backprop") selectiveBackprop = value;
+                else if (key == "backprop_keep_fraction") backpropKeepFraction = std::stod(value);
+                else if (key == "backprop_loss_threshold") backpropLossThreshold = std::stod(value);
+                else if (key == "fused_activation") fusedActivation = value;
+                else if (key == "accumulation_steps") accumulationSteps = std::stoi(value);
+                else if (key == "storage_order") storageOrder = value;
+                else if (key == "augment") augmentation.enabled = value == "true" || value == "1";
+                else if (key == "augment_max_shift") augmentation.maxShift = std::stof(value);
+                else if (key == "augment_max_rotation") augmentation.maxRotationDegrees = std::stof(value);
+                else if (key == "augment_elastic_alpha") augmentation.elasticAlpha = std::stof(value);
+                else if (key == "augment_elastic_sigma") augmentation.elasticSigma = std::stof(value);
+                else if (key == "augment_threads") augmentation.threads = std::stoi(value);
             }
         }
     }
 };
 
+// Train on the training set and evaluate on the test set, with every batch and parameter
+// stored in StorageOrder
+template<int StorageOrder>
+void trainAndTest(const Config& config) {
+    // Initialize components
+    std::shared_ptr<Adam<double>> optimizer = std::make_shared<Adam<double>>(config.learningRate, config.mu, config.rho);
+    std::shared_ptr<He<double>> weightsInitializer = std::make_shared<He<double>>();
+    std::shared_ptr<He<double>> biasInitializer = std::make_shared<He<double>>();
+    CrossEntropyLoss<double, StorageOrder> lossLayer;
+
+    // Training and test data layers
+    DataLayerOptions dataOptions;
+    dataOptions.backend = parseDataBackend(config.dataBackend);
+    dataOptions.numClasses = config.numClasses;
+    dataOptions.prefetchDepth = config.prefetchDepth;
+    dataOptions.seed = config.dataSeed;
+    dataOptions.shuffleMode = parseShuffleMode(config.shuffleMode);
+    dataOptions.shuffleBlockSize = config.shuffleBlockSize;
+    dataOptions.shuffleWindowBlocks = config.shuffleWindowBlocks;
+    dataOptions.streamChunkSize = config.streamChunkSize;
+    dataOptions.shuffleBufferSize = config.shuffleBufferSize;
+    dataOptions.readerThreads = config.readerThreads;
+    dataOptions.importanceFloor = config.importanceFloor;
+    dataOptions.importanceInitialScore = config.importanceInitialScore;
+
+    // Only the training data is split between data-parallel workers
+    DataLayerOptions trainOptions = dataOptions;
+    trainOptions.shardId = config.shardId;
+    trainOptions.shardCount = config.shardCount;
+    trainOptions.augmentation = config.augmentation;
+    auto trainDataLayer = std::make_shared<DataLayer<double, StorageOrder>>(
+        config.trainImagesPath, config.trainLabelsPath, config.batchSize, true, trainOptions);
+
+    // The test set is evaluated once, in file order, whatever order training draws in
+    DataLayerOptions testOptions = dataOptions;
+    testOptions.shuffleMode = ShuffleMode::Full;
+    testOptions.partialFinalBatch = true;
+    DataLayer<double, StorageOrder> testDataLayer(config.testImagesPath, config.testLabelsPath, config.batchSize,
+                                                  false, testOptions);
+
+    // Create the neural network
+    NeuralNetwork<double, StorageOrder> nn(
+        optimizer,
+        weightsInitializer,
+        biasInitializer,
+        trainDataLayer,
+        lossLayer
+    );
+
+    SelectiveBackprop selectiveBackprop;
+    selectiveBackprop.mode = parseSelectiveBackpropMode(config.selectiveBackprop);
+    selectiveBackprop.keep_fraction = config.backpropKeepFraction;
+    selectiveBackprop.loss_threshold = config.backpropLossThreshold;
+    nn.set_selective_backprop(selectiveBackprop);
+    nn.set_accumulation_steps(config.accumulationSteps);
+
+    // Add layers to the network; a fused activation replaces the separate ReLU layer
+    FusedActivation hiddenActivation = parseFusedActivation(config.fusedActivation);
+    nn.append_layer(std::make_unique<FullyConnected<double, StorageOrder>>(trainDataLayer->sampleSize(),
+                                                                           config.hiddenSize, hiddenActivation));
+    if (hiddenActivation == FusedActivation::None) {
+        nn.append_layer(std::make_unique<ReLU<double, StorageOrder>>());
+    }
+    nn.append_layer(std::make_unique<FullyConnected<double, StorageOrder>>(config.hiddenSize,
+                                                                           trainDataLayer->numClasses()));
+    nn.append_layer(std::make_unique<SoftMax<double, StorageOrder>>());
+
+    // Train the network
+    std::cout << "Training the Neural Network..." << std::endl;
+    nn.train(config.numEpochs);
+
+    // Testing the network
+    std::cout << "Testing the Neural Network..." << std::endl;
+    std::ofstream logFile(config.logFilePath);
+    if (!logFile.is_open()) {
+        throw std::runtime_error("Failed to open log file: " + config.logFilePath);
+    }
+
+    size_t currentBatch = 0;
+    size_t correctPredictions = 0;
+    size_t totalPredictions = 0;
+    MatrixType<double, StorageOrder> testImages;
+    LabelVector testLabels;
+
+    // One pass over the test set; the last batch holds whatever samples are left
+    while (testDataLayer.nextInEpoch(testImages, testLabels)) {
+        // Get predictions
+        auto predictions = nn.test(testImages);
+
+        // Log predictions and labels
+        logFile << "Current batch: " << currentBatch << "\n";
+        for (size_t i = 0; i < predictions.rows(); ++i) {
+            Eigen::Index predictedLabel = 0; // Initialize to store the index of the max element
+            predictions.row(i).maxCoeff(&predictedLabel);
+            Eigen::Index trueLabel = testLabels(i);
+
+            logFile << " - image " << totalPredictions
+                    << ": Prediction=" << predictedLabel
+                    << ". Label=" << trueLabel << "\n";
+
+            // Count correct predictions
+            if (predictedLabel == trueLabel) {
+                ++correctPredictions;
+            }
+            ++totalPredictions;
+        }
+
+        ++currentBatch;
+    }
+
+    // Calculate and print accuracy
+    double accuracy = (double)correctPredictions / totalPredictions * 100.0;
+    std::cout << "Testing completed. Accuracy: " << accuracy << "%\n";
+    std::cout << "Results logged to " << config.logFilePath << std::endl;
+}
+
 int main(int argc, char** argv) {
     try {
         // Ensure a config file path argument is passed
@@ -61,86 +224,12 @@ int main(int argc, char** argv) {
         Config config;
         config.load(configFile);
 
-        // Initialize components
-        const size_t inputSize = 28 * 28; // MNIST images are 28x28
-        const size_t outputSize = 10;    // MNIST has 10 digit classes
-        std::shared_ptr<Adam<double>> optimizer = std::make_shared<Adam<double>>(config.learningRate, config.mu, config.rho);
-        std::shared_ptr<He<double>> weightsInitializer = std::make_shared<He<double>>();
-        std::shared_ptr<He<double>> biasInitializer = std::make_shared<He<double>>();
-        CrossEntropyLoss<double> lossLayer;
-
-        // Training and test data layers
-        DataLayer<double> trainDataLayer(config.trainImagesPath, config.trainLabelsPath, config.batchSize, true);
-        DataLayer<double> testDataLayer(config.testImagesPath, config.testLabelsPath, config.batchSize, false);
-
-        // Create the neural network
-        NeuralNetwork<double> nn(
-            optimizer,
-            weightsInitializer,
-            biasInitializer,
-            trainDataLayer,
-            lossLayer
-        );
-
-        // Add layers to the network
-        nn.append_layer(std::make_unique<FullyConnected<double>>(inputSize, config.hiddenSize));
-        nn.append_layer(std::make_unique<ReLU<double>>());
-        nn.append_layer(std::make_unique<FullyConnected<double>>(config.hiddenSize, outputSize));
-        nn.append_layer(std::make_unique<SoftMax<double>>());
-
-        // Train the network
-        std::cout << "Training the Neural Network..." << std::endl;
-        nn.train(config.numEpochs);
-
-        // Testing the network
-        std::cout << "Testing the Neural Network..." << std::endl;
-        std::ofstream logFile(config.logFilePath);
-        if (!logFile.is_open()) {
-            throw std::runtime_error("Failed to open log file: " + config.logFilePath);
-        }
-
-        size_t currentBatch = 0;
-        size_t correctPredictions = 0;
-        size_t totalPredictions = 0;
-
-        while (currentBatch < (10000 / config.batchSize)) {
-            try {
-                // Fetch the next test batch
-                auto [testImages, testLabels] = testDataLayer.next();
-
-                // Get predictions
-                auto predictions = nn.test(testImages);
-
-                // Log predictions and labels
-                logFile << "Current batch: " << currentBatch << "\n";
-                for (size_t i = 0; i < predictions.rows(); ++i) {
-                    Eigen::Index predictedLabel = 0; // Initialize to store the index of the max element
-                    Eigen::Index trueLabel = 0;
-                    predictions.row(i).maxCoeff(&predictedLabel);
-                    testLabels.row(i).maxCoeff(&trueLabel);
-
-                    logFile << " - image " << (currentBatch * config.batchSize + i)
-                            << ": Prediction=" << predictedLabel
-                            << ". Label=" << trueLabel << "\n";
-
-                    // Count correct predictions
-                    if (predictedLabel == trueLabel) {
-                        ++correctPredictions;
-                    }
-                    ++totalPredictions;
-                }
-
-                ++currentBatch;
-            } catch (const std::out_of_range&) {
-                // End of test data
-                break;
-            }
+        // Every storage order is its own instantiation of the network
+        if (parseStorageOrder(config.storageOrder) == Eigen::RowMajor) {
+            trainAndTest<Eigen::RowMajor>(config);
+        } else {
+            trainAndTest<Eigen::ColMajor>(config);
         }
-
-        // Calculate and print accuracy
-        double accuracy = (double)correctPredictions / totalPredictions * 100.0;
-        std::cout << "Testing completed. Accuracy: " << accuracy << "%\n";
-        std::cout << "Results logged to " << config.logFilePath << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "An error occurred: " << e.what() << std::endl;
         return 1;
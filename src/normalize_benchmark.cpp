@@ -0,0 +1,133 @@
+#include "Normalize.hpp"
+#include "Types.hpp"
+#include <Eigen/Dense>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+const size_t imageRows = 28;
+const size_t imageCols = 28;
+const size_t imageSize = imageRows * imageCols;
+
+// Batch assembly as DataLayer used to do it: one temporary matrix per sample, then a row copy
+template<typename ComponentType>
+void perSampleBatch(const std::vector<const uint8_t*>& samples, MatrixType<ComponentType>& batch) {
+    for (size_t i = 0; i < samples.size(); ++i) {
+        Eigen::Map<const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
+            rawImage(samples[i], imageRows, imageCols);
+        MatrixType<ComponentType> image = rawImage.cast<ComponentType>() / static_cast<ComponentType>(255.0);
+        batch.row(i) = Eigen::Map<Eigen::RowVectorX<ComponentType>>(image.data(), imageSize);
+    }
+}
+
+template<typename ComponentType>
+void kernelBatch(const std::vector<const uint8_t*>& samples, MatrixType<ComponentType>& batch) {
+    normalizeBatch<ComponentType>(samples.data(), samples.size(), imageSize, batch.data(),
+                                  batch.outerStride(), static_cast<ComponentType>(1.0 / 255.0));
+}
+
+// Time `assemble` over many random batches and return the destination throughput in GB/s
+template<typename ComponentType, typename Assemble>
+double measure(const std::vector<uint8_t>& dataset, size_t batchSize, size_t iterations, Assemble assemble) {
+    size_t numSamples = dataset.size() / imageSize;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> pick(0, numSamples - 1);
+
+    MatrixType<ComponentType> batch(batchSize, imageSize);
+    std::vector<const uint8_t*> samples(batchSize);
+    double elapsed = 0.0;
+    ComponentType checksum = 0;
+
+    for (size_t it = 0; it < iterations; ++it) {
+        for (auto& sample : samples) {
+            sample = dataset.data() + pick(gen) * imageSize;
+        }
+        auto start = std::chrono::steady_clock::now();
+        assemble(samples, batch);
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        checksum += batch(it % batchSize, it % imageSize);
+    }
+
+    if (checksum < 0) {
+        std::cout << checksum << std::endl; // Keeps the work observable
+    }
+    double bytes = static_cast<double>(iterations) * batchSize * imageSize * sizeof(ComponentType);
+    return bytes / elapsed / 1e9;
+}
+
+// Largest difference between the kernel and a plain Eigen conversion of the same pixels
+template<typename ComponentType>
+double maxError(const std::vector<uint8_t>& dataset, size_t batchSize) {
+    std::vector<const uint8_t*> samples(batchSize);
+    for (size_t i = 0; i < batchSize; ++i) {
+        samples[i] = dataset.data() + (i * 7919 % (dataset.size() / imageSize)) * imageSize;
+    }
+
+    MatrixType<ComponentType> batch(batchSize, imageSize);
+    kernelBatch(samples, batch);
+
+    double error = 0.0;
+    for (size_t i = 0; i < batchSize; ++i) {
+        Eigen::RowVectorX<ComponentType> expected =
+            Eigen::Map<const Eigen::RowVectorX<uint8_t>>(samples[i], imageSize).cast<ComponentType>()
+            / static_cast<ComponentType>(255.0);
+        error = std::max(error, static_cast<double>((batch.row(i) - expected).cwiseAbs().maxCoeff()));
+    }
+    return error;
+}
+
+template<typename ComponentType>
+void run(const std::string& typeName, const std::vector<uint8_t>& dataset, size_t batchSize, size_t iterations) {
+    double legacy = measure<ComponentType>(dataset, batchSize, iterations, perSampleBatch<ComponentType>);
+    double kernel = measure<ComponentType>(dataset, batchSize, iterations, kernelBatch<ComponentType>);
+
+    std::cout << std::left << std::setw(8) << typeName
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(14) << legacy
+              << std::setw(14) << kernel
+              << std::setw(10) << kernel / legacy << "x"
+              << std::scientific << std::setprecision(1)
+              << std::setw(12) << maxError<ComponentType>(dataset, batchSize) << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 4) {
+        std::cerr << "Usage: " << argv[0] << " [batch size] [iterations] [dataset images]" << std::endl;
+        return 1;
+    }
+
+    size_t batchSize = argc > 1 ? std::stoul(argv[1]) : 100;
+    size_t iterations = argc > 2 ? std::stoul(argv[2]) : 2000;
+    size_t numSamples = argc > 3 ? std::stoul(argv[3]) : 60000;
+
+    // Random pixels stand in for an IDX file already resident in memory
+    std::vector<uint8_t> dataset(numSamples * imageSize);
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> pixel(0, 255);
+    for (auto& value : dataset) {
+        value = static_cast<uint8_t>(pixel(gen));
+    }
+
+#if defined(__AVX2__)
+    const char* isa = "AVX2";
+#elif defined(__SSE2__)
+    const char* isa = "SSE2";
+#else
+    const char* isa = "scalar";
+#endif
+
+    std::cout << "Batch assembly, " << batchSize << " x " << imageSize << ", " << iterations
+              << " batches, kernel ISA: " << isa << std::endl;
+    std::cout << std::left << std::setw(8) << "type" << std::right
+              << std::setw(14) << "legacy GB/s" << std::setw(14) << "kernel GB/s"
+              << std::setw(11) << "speedup" << std::setw(12) << "max error" << std::endl;
+
+    run<float>("float", dataset, batchSize, iterations);
+    run<double>("double", dataset, batchSize, iterations);
+
+    return 0;
+}
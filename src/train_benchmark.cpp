@@ -0,0 +1,97 @@
+#include "NeuralNetwork.hpp"
+#include "SyntheticData.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+struct BenchmarkShape {
+    size_t batchSize;
+    size_t inputSize;
+    size_t hiddenSize;
+    size_t numClasses;
+    size_t iterations;
+    FusedActivation activation;
+    size_t accumulationSteps;
+    int storageOrder;
+};
+
+// Train the same network as main on synthetic batches and report its throughput
+template<typename ComponentType, int StorageOrder>
+void run(const std::string& typeName, const BenchmarkShape& shape) {
+    auto data = std::make_shared<SyntheticDataSource<ComponentType, StorageOrder>>(shape.batchSize, shape.inputSize,
+                                                                                   shape.numClasses, 42);
+    auto optimizer = std::make_shared<Adam<ComponentType>>(static_cast<ComponentType>(1e-3),
+                                                           static_cast<ComponentType>(0.9),
+                                                           static_cast<ComponentType>(0.999));
+    auto initializer = std::make_shared<He<ComponentType>>();
+
+    // NeuralNetwork reports every iteration on std::cout; keep that out of the timing
+    std::ostringstream discarded;
+    std::streambuf* console = std::cout.rdbuf(discarded.rdbuf());
+
+    NeuralNetwork<ComponentType, StorageOrder> nn(optimizer, initializer, initializer, data,
+                                                  CrossEntropyLoss<ComponentType, StorageOrder>());
+    nn.set_accumulation_steps(shape.accumulationSteps);
+    nn.append_layer(std::make_unique<FullyConnected<ComponentType, StorageOrder>>(shape.inputSize, shape.hiddenSize,
+                                                                                  shape.activation));
+    if (shape.activation == FusedActivation::None) {
+        nn.append_layer(std::make_unique<ReLU<ComponentType, StorageOrder>>());
+    }
+    nn.append_layer(std::make_unique<FullyConnected<ComponentType, StorageOrder>>(shape.hiddenSize,
+                                                                                  shape.numClasses));
+    nn.append_layer(std::make_unique<SoftMax<ComponentType, StorageOrder>>());
+
+    nn.train(1); // Warm-up: first-touch allocation of every buffer
+    auto start = std::chrono::steady_clock::now();
+    nn.train(shape.iterations);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ComponentType loss = nn.forward();
+
+    std::cout.rdbuf(console);
+    std::cout << std::left << std::setw(8) << typeName
+              << std::right << std::fixed << std::setprecision(3)
+              << std::setw(14) << elapsed * 1e3 / shape.iterations
+              << std::setprecision(0) << std::setw(16)
+              << shape.iterations * shape.accumulationSteps * shape.batchSize / elapsed
+              << std::setprecision(4) << std::setw(14) << loss / shape.batchSize << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 9) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [batch size] [hidden size] [iterations] [input size] [classes] [fused activation: none|relu]"
+                  << " [accumulation steps] [storage order: col-major|row-major]" << std::endl;
+        return 1;
+    }
+
+    BenchmarkShape shape;
+    shape.batchSize = argc > 1 ? std::stoul(argv[1]) : 100;
+    shape.hiddenSize = argc > 2 ? std::stoul(argv[2]) : 128;
+    shape.iterations = argc > 3 ? std::stoul(argv[3]) : 500;
+    shape.inputSize = argc > 4 ? std::stoul(argv[4]) : 28 * 28;
+    shape.numClasses = argc > 5 ? std::stoul(argv[5]) : 10;
+    shape.activation = parseFusedActivation(argc > 6 ? argv[6] : "none");
+    shape.accumulationSteps = argc > 7 ? std::stoul(argv[7]) : 1;
+    shape.storageOrder = parseStorageOrder(argc > 8 ? argv[8] : "col-major");
+
+    std::cout << "Training on synthetic data, batch " << shape.batchSize << ", " << shape.inputSize << " -> "
+              << shape.hiddenSize << " -> " << shape.numClasses << ", " << shape.iterations << " iterations"
+              << (shape.accumulationSteps > 1 ? " of " + std::to_string(shape.accumulationSteps) + " batches" : "")
+              << (shape.activation == FusedActivation::ReLU ? ", fused ReLU" : "")
+              << (shape.storageOrder == Eigen::RowMajor ? ", row-major" : "") << std::endl;
+    std::cout << std::left << std::setw(8) << "type" << std::right
+              << std::setw(14) << "ms/iteration" << std::setw(16) << "samples/s"
+              << std::setw(14) << "final loss" << std::endl;
+
+    if (shape.storageOrder == Eigen::RowMajor) {
+        run<float, Eigen::RowMajor>("float", shape);
+        run<double, Eigen::RowMajor>("double", shape);
+    } else {
+        run<float, Eigen::ColMajor>("float", shape);
+        run<double, Eigen::ColMajor>("double", shape);
+    }
+
+    return 0;
+}